@@ -0,0 +1,233 @@
+/*
+    cache
+    ~~~~~
+
+    A persistent, versioned snapshot of the $PATH directory listings. At
+    startup the file is mapped into memory and each directory's listing is
+    reused as long as the directory's device, inode and mtime still match.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glibmm.h>
+#include <glib/gstdio.h>
+#include "cache.h"
+#include "util.h"
+
+namespace
+{
+    // Bump CACHE_VERSION whenever the layout below changes; older files
+    // are then ignored and rewritten.
+    const char      CACHE_MAGIC[8] = { 't', 'u', 'd', 'o', 'r', 'i', 'd', 'x' };
+    const uint32_t  CACHE_VERSION  = 3;
+
+    struct FileHeader
+    {
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    count;
+    };
+
+    // Followed by the directory path, then |names| NUL-terminated names
+    // taking |bytes| bytes, padded to eight bytes.
+    struct DirHeader
+    {
+        uint64_t    dev;
+        uint64_t    ino;
+        int64_t     mtime_sec;
+        int64_t     mtime_nsec;
+        uint32_t    path_length;
+        uint32_t    names;
+        uint32_t    bytes;
+        uint32_t    reserved;
+    };
+
+    inline size_t align8(size_t n)
+    {
+        return (n + 7) & ~(size_t) 7;
+    }
+}
+
+PathCache::PathCache() : m_map(0), m_size(0)
+{
+}
+
+PathCache::~PathCache()
+{
+    this->close();
+}
+
+std::string PathCache::default_path()
+{
+    return Glib::build_filename(Glib::get_user_cache_dir(),
+                                "tudor-do", "path-index");
+}
+
+bool PathCache::open(const std::string& path)
+{
+    this->close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(FileHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    void* map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+    this->m_map = map;
+    this->m_size = st.st_size;
+
+    const char* base = (const char*) map;
+    FileHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+        || header.version != CACHE_VERSION)
+    {
+        this->close();
+        return false;
+    }
+
+    size_t pos = sizeof(FileHeader);
+    for (uint32_t i = 0; i < header.count; i++)
+    {
+        DirHeader dir;
+        if (pos + sizeof(dir) > this->m_size) break;
+        memcpy(&dir, base + pos, sizeof(dir));
+        pos += sizeof(dir);
+        if ((size_t) dir.path_length + dir.bytes > this->m_size - pos) break;
+
+        Record record;
+        record.stamp.dev        = dir.dev;
+        record.stamp.ino        = dir.ino;
+        record.stamp.mtime_sec  = dir.mtime_sec;
+        record.stamp.mtime_nsec = dir.mtime_nsec;
+        record.count            = dir.names;
+        record.names      = base + pos + dir.path_length;
+        record.end        = record.names + dir.bytes;
+        this->m_records[std::string(base + pos, dir.path_length)] = record;
+        pos += align8(dir.path_length + dir.bytes);
+    }
+    return true;
+}
+
+void PathCache::close()
+{
+    if (this->m_map)
+        munmap(this->m_map, this->m_size);
+    this->m_map = 0;
+    this->m_size = 0;
+    this->m_records.clear();
+}
+
+bool PathCache::restore(const std::string& dir, uint16_t id, PathTrie& trie,
+                        DirectoryStamp& stamp)
+{
+    std::map<std::string, Record>::const_iterator it;
+    if ((it = this->m_records.find(dir)) == this->m_records.end())
+        return false;
+
+    const Record& record = it->second;
+    DirectoryStamp current;
+    if (!current.read(dir) || current != record.stamp)
+        return false;
+
+    const char* name = record.names;
+    for (uint32_t i = 0; i < record.count && name < record.end; i++)
+    {
+        size_t length = strnlen(name, record.end - name);
+        trie.insert(std::string(name, length), id);
+        name += length + 1;
+    }
+    stamp = record.stamp;
+    return true;
+}
+
+void PathCache::serialize(const PathTrie& trie,
+                          const std::vector<DirectoryStamp>& stamps,
+                          std::string& buffer)
+{
+    std::vector<std::vector<const std::string*> > listings;
+    listings.resize(trie.directory_count());
+    for (size_t i = 0; i < trie.capacity(); i++)
+    {
+        const PathTrie::Leaf& leaf = trie.leaf(i);
+        for (size_t d = 0; d < leaf.dirs.size(); d++)
+            listings[leaf.dirs[d]].push_back(&leaf.name);
+    }
+
+    FileHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.count   = 0;
+    buffer.assign((const char*) &header, sizeof(header));
+
+    for (size_t d = 0; d < listings.size(); d++)
+    {
+        // Stamping the directory now could vouch for changes the names
+        // do not reflect yet.
+        if (d >= stamps.size() || !stamps[d].known())
+            continue;
+        const std::string& path = trie.directory(d);
+
+        DirHeader dir;
+        memset(&dir, 0, sizeof(dir));
+        dir.dev         = stamps[d].dev;
+        dir.ino         = stamps[d].ino;
+        dir.mtime_sec   = stamps[d].mtime_sec;
+        dir.mtime_nsec  = stamps[d].mtime_nsec;
+        dir.path_length = path.length();
+        dir.names       = listings[d].size();
+        for (size_t i = 0; i < listings[d].size(); i++)
+            dir.bytes += listings[d][i]->length() + 1;
+
+        buffer.append((const char*) &dir, sizeof(dir));
+        buffer.append(path);
+        for (size_t i = 0; i < listings[d].size(); i++)
+            buffer.append(listings[d][i]->c_str(),
+                          listings[d][i]->length() + 1);
+        buffer.resize(align8(buffer.size()), '\0');
+        header.count++;
+    }
+    memcpy(&buffer[0], &header, sizeof(header));
+}
+
+bool PathCache::write(const std::string& path, const std::string& buffer)
+{
+    std::string dir = Glib::path_get_dirname(path);
+    if (g_mkdir_with_parents(dir.c_str(), 0700) == -1)
+    {
+        warning("cannot create cache directory " + dir);
+        return false;
+    }
+
+    // Write a temporary file and rename it over the old one, so a reader
+    // never maps a half-written index.
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (f == NULL)
+    {
+        warning("cannot write cache " + tmp);
+        return false;
+    }
+    bool ok = fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) == -1)
+    {
+        warning("cannot write cache " + path);
+        g_unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+/*
+    cache
+    ~~~~~
+
+    A persistent, versioned snapshot of the $PATH directory listings. At
+    startup the file is mapped into memory and each directory's listing is
+    reused as long as the directory's device, inode and mtime still match.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_CACHE_H
+#define TUDOR_DO_CACHE_H
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "scan.h"
+#include "trie.h"
+
+class PathCache
+{
+    public:
+        PathCache();
+        virtual ~PathCache();
+
+        static std::string default_path();
+
+        bool open(const std::string& path);
+        void close();
+        // Fills in |stamp| with the stamp the restored listing was saved
+        // with.
+        bool restore(const std::string& dir, uint16_t id, PathTrie& trie,
+                     DirectoryStamp& stamp);
+
+        // Saves every directory of |trie| that has a known stamp in
+        // |stamps|, by directory id. The stamp must describe the directory
+        // as it was when its names in |trie| were read.
+        static void serialize(const PathTrie& trie,
+                              const std::vector<DirectoryStamp>& stamps,
+                              std::string& buffer);
+        static bool write(const std::string& path, const std::string& buffer);
+    protected:
+        struct Record
+        {
+            DirectoryStamp  stamp;
+            uint32_t        count;
+            const char*     names;
+            const char*     end;
+        };
+
+        void*                           m_map;
+        size_t                          m_size;
+        std::map<std::string, Record>   m_records;
+};
+
+#endif /* TUDOR_DO_CACHE_H */
@@ -0,0 +1,418 @@
+/*
+    completer
+    ~~~~~~~~~
+
+    Turns the text typed into the entry into a ranked list of completions,
+    drawn from the filesystem, the environment, the command history and the
+    executables in $PATH.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <glibmm.h>
+#include <glibmm/fileutils.h>
+#include "completer.h"
+#include "monitor.h"
+#include "util.h"
+
+namespace
+{
+    // Lets a remembered command outrank an equally good $PATH match.
+    const int SCORE_HISTORY = 1;
+
+    // Turns a command's frecency into a bonus on top of its match score.
+    // A name launched daily is worth about two well-placed characters of a
+    // fuzzy match; boosts fade as the launches age, so they are refreshed
+    // every BOOST_REFRESH seconds even when nothing has been launched.
+    const double FRECENCY_WEIGHT = 8;
+    const time_t BOOST_REFRESH = 60;
+
+    inline int boost(double frecency)
+    {
+        return (int) (FRECENCY_WEIGHT * log2(1 + frecency));
+    }
+
+    // Number of recently browsed directories whose listings are kept.
+    const size_t DIRECTORY_CACHE_SIZE = 16;
+
+    // How long, in milliseconds, a query waits for a directory that is
+    // still being read, and how often it checks for cancellation meanwhile.
+    const int FILE_QUERY_BUDGET = 100;
+    const int FILE_WAIT_SLICE = 10;
+
+    void add_file(const std::string& dir_name, const char* name,
+                  TopK<Completion, CompletionBetter>& best)
+    {
+        std::string full_path = Glib::build_filename(dir_name, name);
+        find_and_replace(full_path, " ", "\\ ");
+        Completion completion(dir_name, full_path);
+        if (best.accepts(completion))
+            best.push(completion);
+    }
+}
+
+Completer::Completer(PathMonitor& monitor, const Environment& environment,
+                     const History& history) :
+m_monitor(monitor), m_environment(environment), m_history(history),
+m_mode(MATCH_PREFIX), m_limit(50),
+m_next_mode(MATCH_PREFIX), m_next_limit(50), m_reset(false),
+m_directories(DIRECTORY_CACHE_SIZE), m_thread(0),
+m_stop(false), m_generation(0), m_query_generation(0), m_pending(false),
+m_results_generation(0), m_ready(false), m_boost_generation(0),
+m_boost_time(0)
+{
+    this->m_directories.sig_ready.connect(sigc::mem_fun(*this,
+        &Completer::on_directory_ready));
+}
+
+Completer::~Completer()
+{
+    this->stop();
+    if (this->m_thread)
+        this->m_thread->join();
+}
+
+void Completer::set_mode(MatchMode mode)
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    this->m_next_mode = mode;
+    this->m_reset = true;
+}
+
+void Completer::set_limit(size_t limit)
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    this->m_next_limit = limit;
+    this->m_reset = true;
+}
+
+void Completer::submit(const std::string& text)
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    this->m_text = text;
+    this->m_pending = true;
+    g_atomic_int_inc(&this->m_generation);
+    this->m_cond.signal();
+}
+
+bool Completer::take_results(std::vector<Completion>& results)
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    if (!this->m_ready
+        || this->m_results_generation != g_atomic_int_get(&this->m_generation))
+        return false;
+    results.swap(this->m_results);
+    this->m_results.clear();
+    this->m_ready = false;
+    return true;
+}
+
+void Completer::start()
+{
+    this->m_directories.start();
+    this->m_thread = Glib::Thread::create(sigc::mem_fun(*this,
+        &Completer::run), true);
+}
+
+void Completer::stop()
+{
+    this->m_directories.stop();
+    Glib::Mutex::Lock lock(this->m_mutex);
+    this->m_stop = true;
+    this->m_cond.signal();
+}
+
+void Completer::run()
+{
+    while (true)
+    {
+        std::string text;
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            while (!this->m_stop && !this->m_pending)
+                this->m_cond.wait(this->m_mutex);
+            if (this->m_stop)
+                break;
+            text = this->m_text;
+            this->m_pending = false;
+            this->m_partial_directory.clear();
+            if (this->m_reset)
+            {
+                this->m_mode = this->m_next_mode;
+                this->m_limit = this->m_next_limit;
+                this->m_frames.clear();
+                this->m_reset = false;
+            }
+            this->m_query_generation = g_atomic_int_get(&this->m_generation);
+        }
+
+        std::vector<Completion> results;
+        if (!this->complete(text, results))
+            continue;
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            if (this->cancelled())
+                continue;
+            this->m_results.swap(results);
+            this->m_results_generation = this->m_query_generation;
+            this->m_ready = true;
+        }
+        this->sig_done();
+    }
+}
+
+bool Completer::cancelled()
+{
+    return this->m_query_generation != g_atomic_int_get(&this->m_generation);
+}
+
+size_t Completer::min_length() const
+{
+    return (this->m_mode == MATCH_FUZZY) ? 1 : 3;
+}
+
+std::string Completer::current_word(const std::string& text)
+{
+    int space_pos = find_last_space_pos(text);
+    if (std::string::npos != space_pos)
+        return text.substr(++space_pos, -1);
+    return text;
+}
+
+bool Completer::complete(const std::string& text,
+                         std::vector<Completion>& results)
+{
+    std::string word = Completer::current_word(text);
+    if (word.empty() || word.length() < this->min_length())
+    {
+        this->m_frames.clear();
+        return true;
+    }
+
+    t_best best(this->m_limit);
+    if (word[0] == '/' || word[0] == '$')
+    {
+        this->m_frames.clear();
+        if (word[0] == '/')
+            this->complete_file(word, best);
+        else
+            this->complete_env(word, best);
+        this->complete_history(word, best);
+        if (this->cancelled())
+            return false;
+        best.take(results);
+        return true;
+    }
+
+    // New boosts move the index generation on, so refresh them first.
+    this->update_boosts();
+
+    // Drop the frames this word no longer extends. What is left on top is
+    // either the word itself (after a backspace) or its closest parent.
+    if (!this->m_frames.empty()
+        && this->m_frames.front().candidates.generation
+           != this->m_monitor.generation())
+        this->m_frames.clear();
+    while (!this->m_frames.empty()
+           && word.compare(0, this->m_frames.back().word.length(),
+                           this->m_frames.back().word) != 0)
+        this->m_frames.pop_back();
+    if (!this->m_frames.empty() && this->m_frames.back().word == word)
+    {
+        results = this->m_frames.back().results;
+        return true;
+    }
+
+    const Frame* parent = this->m_frames.empty() ? 0 : &this->m_frames.back();
+    this->m_frames.push_back(Frame());
+    Frame& frame = this->m_frames.back();
+    frame.word = word;
+    this->complete_history(word, best);
+    if (!this->cancelled())
+        this->complete_path(word, parent, frame, best);
+    if (this->cancelled())
+    {
+        // A half-built frame would poison later narrowing.
+        this->m_frames.pop_back();
+        return false;
+    }
+    best.take(frame.results);
+    results = frame.results;
+    return true;
+}
+
+void Completer::complete_file(const std::string& text, t_best& best)
+{
+    std::string dir_name, base_name;
+
+    dir_name  = Glib::path_get_dirname(text);
+    base_name = Glib::path_get_basename(text);
+
+    find_and_replace(dir_name, "\\ ", " ");
+    bool list_all = (text[text.length() - 1] == '/');
+    bool reading;
+    const NameIndex* listing = this->m_directories.get(dir_name, reading);
+    if (listing)
+    {
+        NameIndex::range range(listing->begin(), listing->end());
+        if (!list_all)
+            range = listing->prefix_range(base_name);
+        size_t seen = 0;
+        for (NameIndex::const_iterator it = range.first;
+             it != range.second;
+             ++it)
+        {
+            if ((++seen & 0xff) == 0 && this->cancelled())
+                return;
+            add_file(dir_name, listing->name(*it), best);
+        }
+        return;
+    }
+    if (!reading)
+        return;
+
+    // Rank names as the I/O thread streams them in. Once there are enough
+    // of them, or the time budget runs out, the query settles for what it
+    // has; it is run again when the whole directory has been read.
+    Glib::TimeVal deadline, now, slice;
+    deadline.assign_current_time();
+    deadline.add_milliseconds(FILE_QUERY_BUDGET);
+    std::vector<char> names;
+    size_t offset = 0, seen = 0;
+    DirectoryCache::ReadStatus status = DirectoryCache::READ_MORE;
+    while (status == DirectoryCache::READ_MORE)
+    {
+        now.assign_current_time();
+        if (best.full() || !(now < deadline))
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            this->m_partial_directory = dir_name;
+            return;
+        }
+        slice = now;
+        slice.add_milliseconds(FILE_WAIT_SLICE);
+        if (deadline < slice)
+            slice = deadline;
+
+        names.clear();
+        status = this->m_directories.wait(dir_name, offset, names, slice);
+        for (size_t pos = 0; pos < names.size();
+             pos += strlen(&names[pos]) + 1)
+        {
+            if ((++seen & 0xff) == 0 && this->cancelled())
+                return;
+            const char* name = &names[pos];
+            if (list_all
+                || strncmp(name, base_name.c_str(), base_name.length()) == 0)
+                add_file(dir_name, name, best);
+        }
+        if (this->cancelled())
+            return;
+    }
+}
+
+void Completer::on_directory_ready(std::string path)
+{
+    // Runs on the directory cache's I/O thread. The last query only saw
+    // part of this directory, so it is run again, now from the cache.
+    Glib::Mutex::Lock lock(this->m_mutex);
+    if (path != this->m_partial_directory || this->m_pending)
+        return;
+    this->m_partial_directory.clear();
+    this->m_pending = true;
+    g_atomic_int_inc(&this->m_generation);
+    this->m_cond.signal();
+}
+
+void Completer::complete_env(const std::string& text, t_best& best)
+{
+    std::vector<std::string> names;
+    this->m_environment.complete(text.substr(1), names);
+    for (size_t i = 0; i < names.size(); i++)
+        best.push(Completion("", "$" + names[i]));
+}
+
+void Completer::update_boosts()
+{
+    time_t now = time(0);
+    if (this->m_history.generation() == this->m_boost_generation
+        && now - this->m_boost_time < BOOST_REFRESH)
+        return;
+    this->m_boost_generation = this->m_history.generation();
+    this->m_boost_time = now;
+
+    // A $PATH name is boosted by every command line that runs it.
+    std::map<std::string, double> frecency;
+    {
+        History::Lock lock(this->m_history);
+        const History::t_records& records = this->m_history.records();
+        for (History::t_records::const_iterator iter = records.begin();
+             iter != records.end();
+             ++iter)
+        {
+            std::string name = iter->first.substr(0, iter->first.find(' '));
+            frecency[name] += History::frecency(iter->second, now);
+        }
+    }
+    std::map<std::string, int> boosts;
+    for (std::map<std::string, double>::const_iterator iter =
+             frecency.begin();
+         iter != frecency.end();
+         ++iter)
+        if (int bonus = boost(iter->second))
+            boosts[iter->first] = bonus;
+    this->m_monitor.set_boosts(boosts);
+}
+
+void Completer::complete_history(const std::string& text, t_best& best)
+{
+    time_t now = time(0);
+    History::Lock lock(this->m_history);
+    History::t_range range;
+    if (this->m_mode == MATCH_FUZZY)
+    {
+        this->m_matcher.set_query(text);
+        range.first = this->m_history.records().begin();
+        range.second = this->m_history.records().end();
+    }
+    else
+        range = this->m_history.prefix_range(text);
+
+    for (History::t_records::const_iterator iter = range.first;
+         iter != range.second;
+         ++iter)
+    {
+        // Bare names are offered from $PATH already.
+        const std::string& command = iter->first;
+        if (command.find(' ') == std::string::npos)
+            continue;
+        int score = 0;
+        if (this->m_mode == MATCH_FUZZY
+            && (score = this->m_matcher.score(command)) < 0)
+            continue;
+        score += SCORE_HISTORY + boost(History::frecency(iter->second, now));
+        best.push(Completion("", command, score));
+    }
+}
+
+void Completer::complete_path(const std::string& text, const Frame* parent,
+                              Frame& frame, t_best& best)
+{
+    std::vector<Completion> matches;
+    const PathMonitor::Candidates* narrow = parent ? &parent->candidates : 0;
+    if (this->m_mode == MATCH_FUZZY)
+    {
+        this->m_matcher.set_query(text);
+        this->m_monitor.find_fuzzy(this->m_matcher, this->m_limit, narrow,
+                                   frame.candidates, matches);
+    }
+    else
+        this->m_monitor.find_prefix(text, this->m_limit, narrow,
+                                    frame.candidates, matches);
+    for (size_t i = 0; i < matches.size(); i++)
+        best.push(matches[i]);
+}
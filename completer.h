@@ -0,0 +1,113 @@
+/*
+    completer
+    ~~~~~~~~~
+
+    Turns the text typed into the entry into a ranked list of completions,
+    drawn from the filesystem, the environment, the command history and the
+    executables in $PATH. Queries run on a worker thread; a newer query
+    cancels any older one still in flight.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_COMPLETER_H
+#define TUDOR_DO_COMPLETER_H
+#include <deque>
+#include <string>
+#include <vector>
+#include <glibmm.h>
+#include "dircache.h"
+#include "environment.h"
+#include "fuzzy.h"
+#include "history.h"
+#include "monitor.h"
+#include "results.h"
+
+enum MatchMode
+{
+    MATCH_PREFIX,
+    MATCH_FUZZY
+};
+
+class Completer
+{
+    public:
+        typedef TopK<Completion, CompletionBetter> t_best;
+
+        Glib::Dispatcher sig_done;
+
+        Completer(PathMonitor& monitor, const Environment& environment,
+                  const History& history);
+        virtual ~Completer();
+
+        // Settings take effect from the next submitted query.
+        void set_mode(MatchMode mode);
+        inline MatchMode get_mode() const { return this->m_next_mode; }
+        void set_limit(size_t limit);
+        inline size_t get_limit() const { return this->m_next_limit; }
+
+        void submit(const std::string& text);
+        bool take_results(std::vector<Completion>& results);
+        void start();
+        void stop();
+
+        static std::string current_word(const std::string& text);
+    protected:
+        PathMonitor&            m_monitor;
+        const Environment&      m_environment;
+        const History&          m_history;
+        MatchMode               m_mode;
+        size_t                  m_limit;
+        MatchMode               m_next_mode;
+        size_t                  m_next_limit;
+        bool                    m_reset;
+        FuzzyMatcher            m_matcher;
+        DirectoryCache          m_directories;
+
+        Glib::Thread*           m_thread;
+        Glib::Mutex             m_mutex;
+        Glib::Cond              m_cond;
+        bool                    m_stop;
+
+        // Bumped by every submit(); the worker abandons a query as soon as
+        // it notices the generation has moved on.
+        gint                    m_generation;
+        gint                    m_query_generation;
+        std::string             m_text;
+        bool                    m_pending;
+        std::vector<Completion> m_results;
+        gint                    m_results_generation;
+        bool                    m_ready;
+        // Set when a query gave up waiting for this directory to be read.
+        std::string             m_partial_directory;
+        // The history generation and time the $PATH boosts were computed
+        // from.
+        unsigned int            m_boost_generation;
+        time_t                  m_boost_time;
+
+        // One frame per word typed since the last full scan: the results
+        // shown for it and the PATH candidates it matched. A deque keeps
+        // the parent frame in place while its child is pushed.
+        struct Frame
+        {
+            std::string                 word;
+            PathMonitor::Candidates     candidates;
+            std::vector<Completion>     results;
+        };
+        std::deque<Frame>       m_frames;
+
+        void run();
+        bool cancelled();
+        size_t min_length() const;
+        bool complete(const std::string& text,
+                      std::vector<Completion>& results);
+        void update_boosts();
+        void complete_file(const std::string& text, t_best& best);
+        void on_directory_ready(std::string path);
+        void complete_env(const std::string& text, t_best& best);
+        void complete_history(const std::string& text, t_best& best);
+        void complete_path(const std::string& text, const Frame* parent,
+                           Frame& frame, t_best& best);
+};
+
+#endif /* TUDOR_DO_COMPLETER_H */
@@ -2,12 +2,39 @@ NAME := tudor-do
 CXX  := g++
 
 BIN     := $(NAME)
-OBJECTS := monitor.o inotify-cxx.o xkeybind.o util.o $(NAME).o
+OBJECTS := index.o fuzzy.o trie.o cache.o scan.o metadata.o monitor.o \
+           dircache.o environment.o history.o completer.o result-model.o \
+           launcher.o zygote.o inotify-cxx.o xkeybind.o util.o $(NAME).o
 
-GTK_CFLAGS  := gtkmm-2.4
-GTK_LDFLAGS := $(GTK_CFLAGS)
+# Tests link the index and the monitor only, so they build without GTK
+# or X. SANITIZE=thread (after a make clean) builds everything under
+# ThreadSanitizer.
+TESTS        := tests/snapshot-test
+TEST_OBJECTS := fuzzy.o trie.o cache.o scan.o metadata.o monitor.o \
+                inotify-cxx.o util.o
 
-CXXFLAGS += $(foreach p,$(GTK_CFLAGS),$(shell pkg-config --cflags $(p)))
+# Benchmarks of inotify-cxx and the launcher, run by make bench.
+BENCHMARKS    := tests/event-bench tests/watch-bench tests/launch-bench
+BENCH_OBJECTS := inotify-cxx.o launcher.o zygote.o
+
+GLIB_CFLAGS  := glibmm-2.4 gthread-2.0
+GLIB_LDFLAGS := $(GLIB_CFLAGS)
+GTK_CFLAGS   := gtkmm-2.4
+GTK_LDFLAGS  := $(GTK_CFLAGS)
+
+CXXFLAGS += $(foreach p,$(GLIB_CFLAGS),$(shell pkg-config --cflags $(p)))
+ifdef SANITIZE
+CXXFLAGS += -O1 -g -fsanitize=$(SANITIZE)
+endif
+
+# Only the dialog, and the objects built for it, need GTK.
+$(BIN): CXXFLAGS += $(foreach p,$(GTK_CFLAGS),$(shell pkg-config --cflags $(p)))
 
 LIBS += -lX11 -lstdc++
 LIBS += $(foreach p,$(GTK_LDFLAGS),$(shell pkg-config --libs $(p)))
+
+BENCH_LIBS += -lstdc++
+BENCH_LIBS += $(foreach p,$(GLIB_LDFLAGS),$(shell pkg-config --libs $(p)))
+
+TEST_LIBS += -lstdc++
+TEST_LIBS += $(foreach p,$(GLIB_LDFLAGS),$(shell pkg-config --libs $(p)))
@@ -0,0 +1,359 @@
+/*
+    dircache
+    ~~~~~~~~
+
+    Keeps the sorted listings of the directories most recently browsed from
+    the entry. Each cached directory carries an inotify watch of its own, so
+    a listing is dropped as soon as the directory changes and is otherwise
+    served without touching the disk.
+
+    Directories are watched and read on a separate I/O thread and their
+    names are streamed to the caller as they arrive, so a huge directory or
+    a hung network mount never holds a query up for longer than it is
+    willing to wait. The caller's thread never looks a path up.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <cstring>
+#include <vector>
+#include "dircache.h"
+#include "util.h"
+
+namespace
+{
+    // Anything that changes the set of names, or the directory itself.
+    const uint32_t DIRCACHE_EVENTS = IN_CREATE | IN_DELETE | IN_MOVE |
+                                     IN_DELETE_SELF | IN_MOVE_SELF |
+                                     IN_ONLYDIR;
+
+    void build_index(const DirectoryScan::Listing& names, NameIndex& listing)
+    {
+        listing.clear();
+        listing.reserve(names.count, names.names.size());
+        uint32_t tag = listing.add_tag(names.path);
+        for (size_t i = 0, pos = 0; i < names.count; i++)
+        {
+            const char* name = &names.names[pos];
+            size_t length = strlen(name);
+            listing.insert(name, length, tag);
+            pos += length + 1;
+        }
+        listing.sort();
+    }
+}
+
+DirectoryCache::DirectoryCache(size_t capacity) :
+m_capacity(capacity ? capacity : 1), m_notify(0), m_thread(0), m_stop(false)
+{
+    try
+    {
+        this->m_notify = new Inotify();
+        this->m_notify->SetNonBlock(true);
+        this->m_notify->SetCloseOnExec(true);
+    } catch (InotifyException& e) {
+        warning(e.GetMessage());
+        delete this->m_notify;
+        this->m_notify = 0;
+    }
+}
+
+DirectoryCache::~DirectoryCache()
+{
+    this->stop();
+    if (this->m_thread)
+        this->m_thread->join();
+
+    // Only abandoned streams are left to the I/O thread alone.
+    for (size_t i = 0; i < this->m_queue.size(); i++)
+        if (this->m_queue[i]->orphaned)
+            delete this->m_queue[i];
+    delete this->m_notify;
+    for (t_entries::iterator it = this->m_entries.begin();
+         it != this->m_entries.end();
+         ++it)
+    {
+        delete it->stream;
+        delete it->watch;
+    }
+}
+
+void DirectoryCache::start()
+{
+    this->m_thread = Glib::Thread::create(sigc::mem_fun(*this,
+        &DirectoryCache::run), true);
+}
+
+void DirectoryCache::stop()
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    this->m_stop = true;
+    this->m_cond.broadcast();
+}
+
+const NameIndex* DirectoryCache::get(const std::string& path, bool& reading)
+{
+    reading = false;
+    this->invalidate();
+
+    std::map<std::string, t_entries::iterator>::iterator found;
+    if ((found = this->m_lookup.find(path)) == this->m_lookup.end())
+    {
+        Stream* stream = new Stream();
+        stream->listing.path  = path;
+        stream->listing.dev   = 0;
+        stream->listing.count = 0;
+        stream->listing.ok    = false;
+        stream->done          = false;
+        stream->orphaned      = false;
+
+        this->m_entries.push_front(Entry());
+        Entry& entry = this->m_entries.front();
+        entry.path   = path;
+        entry.watch  = 0;       // until the I/O thread has added it
+        entry.stream = stream;
+        this->m_lookup[path] = this->m_entries.begin();
+        while (this->m_entries.size() > this->m_capacity)
+            this->evict(--this->m_entries.end());
+
+        Glib::Mutex::Lock lock(this->m_mutex);
+        this->m_queue.push_back(stream);
+        this->m_cond.broadcast();
+        reading = true;
+        return 0;
+    }
+
+    t_entries::iterator it = found->second;
+    this->m_entries.splice(this->m_entries.begin(), this->m_entries, it);
+    if (it->stream)
+    {
+        bool done, ok;
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            // The watch was added before the read began.
+            this->adopt_watches();
+            done = it->stream->done;
+            ok = it->stream->listing.ok;
+        }
+        if (!done)
+        {
+            reading = true;
+            return 0;
+        }
+        if (!ok)
+        {
+            this->evict(it);
+            return 0;
+        }
+        // The I/O thread is done with the stream.
+        build_index(it->stream->listing, it->listing);
+        delete it->stream;
+        it->stream = 0;
+    }
+
+    // Without a watch nothing would tell a stale listing apart, so it is
+    // handed out once and forgotten.
+    if (!it->watch)
+    {
+        this->m_uncached = it->listing;
+        this->evict(it);
+        return &this->m_uncached;
+    }
+    return &it->listing;
+}
+
+DirectoryCache::ReadStatus DirectoryCache::wait(const std::string& path,
+                                                size_t& offset,
+                                                std::vector<char>& names,
+                                                const Glib::TimeVal& deadline)
+{
+    std::map<std::string, t_entries::iterator>::iterator found;
+    if ((found = this->m_lookup.find(path)) == this->m_lookup.end())
+        return READ_FAILED;
+    Stream* stream = found->second->stream;
+    if (!stream)
+        return READ_DONE;
+
+    Glib::Mutex::Lock lock(this->m_mutex);
+    while (!stream->done && stream->listing.names.size() == offset)
+        if (!this->m_cond.timed_wait(this->m_mutex, deadline))
+            break;
+    names.insert(names.end(), stream->listing.names.begin() + offset,
+                 stream->listing.names.end());
+    offset = stream->listing.names.size();
+    if (!stream->done)
+        return READ_MORE;
+    return stream->listing.ok ? READ_DONE : READ_FAILED;
+}
+
+void DirectoryCache::run()
+{
+    DirectoryReader reader;
+    DirectoryScan::Listing batch;
+    while (true)
+    {
+        Stream* stream;
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            while (!this->m_stop && this->m_queue.empty())
+                this->m_cond.wait(this->m_mutex);
+            if (this->m_stop)
+                break;
+            stream = this->m_queue.front();
+            this->m_queue.pop_front();
+            if (stream->orphaned)
+            {
+                delete stream;
+                continue;
+            }
+        }
+
+        // The path never changes once the stream is queued.
+        batch.path = stream->listing.path;
+
+        // Watch the directory before reading it, so a change made while it
+        // is being read still invalidates the listing. Adding a watch looks
+        // the path up, so it is done here rather than in get().
+        if (this->m_notify)
+        {
+            int32_t wd = inotify_add_watch(this->m_notify->GetDescriptor(),
+                                           batch.path.c_str(),
+                                           DIRCACHE_EVENTS);
+            if (wd != -1)
+            {
+                Glib::Mutex::Lock lock(this->m_mutex);
+                this->m_added.push_back(std::make_pair(batch.path, wd));
+            }
+        }
+        bool more = reader.open(batch);
+        bool orphaned = false;
+        while (more && !orphaned)
+        {
+            batch.names.clear();
+            batch.inodes.clear();
+            batch.types.clear();
+            batch.count = 0;
+            more = reader.read(batch);
+
+            Glib::Mutex::Lock lock(this->m_mutex);
+            DirectoryScan::Listing& listing = stream->listing;
+            listing.dev = batch.dev;
+            listing.stamp = batch.stamp;
+            listing.names.insert(listing.names.end(), batch.names.begin(),
+                                 batch.names.end());
+            listing.inodes.insert(listing.inodes.end(), batch.inodes.begin(),
+                                  batch.inodes.end());
+            listing.types.insert(listing.types.end(), batch.types.begin(),
+                                 batch.types.end());
+            listing.count += batch.count;
+            orphaned = stream->orphaned;
+            this->m_cond.broadcast();
+        }
+        reader.close();
+
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            stream->done = true;
+            stream->listing.ok = !reader.failed();
+            orphaned = stream->orphaned;
+            if (orphaned)
+                delete stream;
+            this->m_cond.broadcast();
+        }
+        if (!orphaned)
+            this->sig_ready(batch.path);
+    }
+}
+
+void DirectoryCache::adopt_watches()
+{
+    // Called with m_mutex held. A watch whose directory is no longer
+    // cached is removed again, unless it is also another entry's, as for
+    // two paths to one directory; such an entry goes without a watch.
+    std::map<std::string, t_entries::iterator>::iterator found;
+    for (size_t i = 0; i < this->m_added.size(); i++)
+    {
+        const std::string& path = this->m_added[i].first;
+        int32_t wd = this->m_added[i].second;
+        found = this->m_lookup.find(path);
+        if (found != this->m_lookup.end() && !found->second->watch)
+        {
+            InotifyWatch* watch = new InotifyWatch(path, DIRCACHE_EVENTS);
+            try
+            {
+                this->m_notify->Adopt(watch, wd);
+                found->second->watch = watch;
+                continue;
+            } catch (InotifyException) {
+                delete watch;
+            }
+        }
+        if (!this->m_notify->FindWatch(wd))
+            inotify_rm_watch(this->m_notify->GetDescriptor(), wd);
+    }
+    this->m_added.clear();
+}
+
+void DirectoryCache::invalidate()
+{
+    if (!this->m_notify) return;
+
+    // Collect every changed directory before evicting anything: queued
+    // events still point at the watches an eviction deletes.
+    std::vector<std::string> changed;
+    std::vector<InotifyEventView> events;
+    try
+    {
+        // Events of a descriptor not yet adopted are skipped. Adopting and
+        // reading under one lock confines those to changes made before the
+        // I/O thread began reading, which its listing already shows.
+        Glib::Mutex::Lock lock(this->m_mutex);
+        this->adopt_watches();
+        while (true)
+        {
+            this->m_notify->ReadEvents(events);
+            if (events.empty())
+                break;
+            for (size_t i = 0; i < events.size(); i++)
+                changed.push_back(events[i].GetWatch()->GetPath());
+        }
+    } catch (InotifyException& e) {
+        warning(e.GetMessage());
+    }
+
+    // Events were lost, so any listing may be stale.
+    if (this->m_notify->CheckOverflow())
+    {
+        while (!this->m_entries.empty())
+            this->evict(this->m_entries.begin());
+        return;
+    }
+
+    std::map<std::string, t_entries::iterator>::iterator found;
+    for (size_t i = 0; i < changed.size(); i++)
+        if ((found = this->m_lookup.find(changed[i])) != this->m_lookup.end())
+            this->evict(found->second);
+}
+
+void DirectoryCache::evict(t_entries::iterator it)
+{
+    if (it->watch)
+    {
+        try
+        {
+            this->m_notify->Remove(it->watch);
+        } catch (InotifyException) { }
+        delete it->watch;
+    }
+    if (it->stream)
+    {
+        // A stream still being read is left for the I/O thread to free.
+        Glib::Mutex::Lock lock(this->m_mutex);
+        if (it->stream->done)
+            delete it->stream;
+        else
+            it->stream->orphaned = true;
+    }
+    this->m_lookup.erase(it->path);
+    this->m_entries.erase(it);
+}
@@ -0,0 +1,103 @@
+/*
+    dircache
+    ~~~~~~~~
+
+    Keeps the sorted listings of the directories most recently browsed from
+    the entry. Each cached directory carries an inotify watch of its own, so
+    a listing is dropped as soon as the directory changes and is otherwise
+    served without touching the disk.
+
+    Directories are watched and read on a separate I/O thread and their
+    names are streamed to the caller as they arrive, so a huge directory or
+    a hung network mount never holds a query up for longer than it is
+    willing to wait. The caller's thread never looks a path up.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_DIRCACHE_H
+#define TUDOR_DO_DIRCACHE_H
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <glibmm.h>
+#include "index.h"
+#include "inotify-cxx.h"
+#include "scan.h"
+
+class DirectoryCache
+{
+    public:
+        enum ReadStatus
+        {
+            READ_MORE,
+            READ_DONE,
+            READ_FAILED
+        };
+
+        // Emitted from the I/O thread once a directory has been read
+        // completely and get() will return its listing.
+        sigc::signal<void, std::string> sig_ready;
+
+        DirectoryCache(size_t capacity);
+        virtual ~DirectoryCache();
+        void start();
+        void stop();
+
+        // Returns the sorted listing of |path|, or 0 if it has not been
+        // read completely yet (|reading| is then set and wait() streams
+        // its names) or cannot be read. The listing stays valid until the
+        // next call. Apart from the I/O thread, the cache is meant to be
+        // used from a single thread.
+        const NameIndex* get(const std::string& path, bool& reading);
+
+        // Appends the names of |path| read past |offset| to |names| and
+        // advances |offset|, waiting until more names arrive or |deadline|
+        // passes. Returns READ_MORE while names may still follow.
+        ReadStatus wait(const std::string& path, size_t& offset,
+                        std::vector<char>& names,
+                        const Glib::TimeVal& deadline);
+        inline size_t size() const { return this->m_entries.size(); }
+    protected:
+        // A directory the I/O thread reads or has read. It is shared with
+        // the I/O thread, which deletes it if the cache has given up on it
+        // by the time the read finishes.
+        struct Stream
+        {
+            DirectoryScan::Listing  listing;
+            bool                    done;
+            bool                    orphaned;
+        };
+
+        struct Entry
+        {
+            std::string     path;
+            NameIndex       listing;
+            InotifyWatch*   watch;
+            Stream*         stream;     // until the listing is complete
+        };
+        typedef std::list<Entry> t_entries;
+
+        size_t                                      m_capacity;
+        t_entries                                   m_entries;  // newest first
+        std::map<std::string, t_entries::iterator>  m_lookup;
+        Inotify*                                    m_notify;
+        NameIndex                                   m_uncached;
+        // Watch descriptors the I/O thread added, by path, that are yet
+        // to be adopted by m_notify.
+        std::vector<std::pair<std::string, int32_t> > m_added;
+
+        Glib::Thread*                               m_thread;
+        Glib::Mutex                                 m_mutex;
+        Glib::Cond                                  m_cond;
+        std::deque<Stream*>                         m_queue;
+        bool                                        m_stop;
+
+        void run();
+        void adopt_watches();
+        void invalidate();
+        void evict(t_entries::iterator it);
+};
+
+#endif /* TUDOR_DO_DIRCACHE_H */
@@ -0,0 +1,139 @@
+/*
+    environment
+    ~~~~~~~~~~~
+
+    A sorted snapshot of the process environment, so completing a variable
+    name is a range lookup and expanding one does not read the environment
+    again.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <cctype>
+#include <cstring>
+#include "environment.h"
+
+extern char** environ;
+
+namespace
+{
+    inline bool is_name_char(char c)
+    {
+        return isalnum((unsigned char) c) || c == '_';
+    }
+
+    // Appends |value| so that Launcher::tokenize reads it back literally.
+    // Unquoted, blanks are left alone, so a value is still split into
+    // words as a shell would split it.
+    void append_quoted(std::string& result, const std::string& value,
+                       bool in_double)
+    {
+        for (size_t i = 0; i < value.length(); i++)
+        {
+            char c = value[i];
+            if (in_double ? strchr("\"\\$`", c) != NULL
+                          : !(c == ' ' || c == '\t' || c == '\n'))
+                result += '\\';
+            result += c;
+        }
+    }
+}
+
+Environment::Environment()
+{
+    this->refresh();
+}
+
+Environment::~Environment()
+{
+}
+
+void Environment::refresh()
+{
+    NameIndex index;
+    for (char** var = environ; *var; var++)
+    {
+        const char* eq = strchr(*var, '=');
+        if (!eq || eq == *var) continue;
+        index.insert(*var, eq - *var, index.add_tag(eq + 1));
+    }
+    index.sort();
+
+    Glib::Mutex::Lock lock(this->m_mutex);
+    this->m_index = index;
+}
+
+void Environment::set(const std::string& name, const std::string& value)
+{
+    Glib::setenv(name, value, true);
+    this->refresh();
+}
+
+void Environment::unset(const std::string& name)
+{
+    Glib::unsetenv(name);
+    this->refresh();
+}
+
+void Environment::complete(const std::string& prefix,
+                           std::vector<std::string>& names) const
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    NameIndex::range range = this->m_index.prefix_range(prefix);
+    for (NameIndex::const_iterator it = range.first; it != range.second; ++it)
+        names.push_back(std::string(this->m_index.name(*it), it->length));
+}
+
+bool Environment::lookup(const std::string& name, std::string& value) const
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    NameIndex::const_iterator it = this->m_index.find(name);
+    if (it == this->m_index.end())
+        return false;
+    value = this->m_index.tag(*it);
+    return true;
+}
+
+std::string Environment::expand(const std::string& text) const
+{
+    std::string result;
+    bool in_single = false, in_double = false;
+    Glib::Mutex::Lock lock(this->m_mutex);
+    for (size_t i = 0; i < text.length(); i++)
+    {
+        char c = text[i];
+        if (c == '\\' && !in_single && i + 1 < text.length())
+        {
+            // Leave escapes for the tokenizer.
+            result += c;
+            result += text[++i];
+            continue;
+        }
+        if (c == '\'' && !in_double)
+            in_single = !in_single;
+        else if (c == '"' && !in_single)
+            in_double = !in_double;
+        if (c != '$' || in_single)
+        {
+            result += c;
+            continue;
+        }
+
+        bool braced = (i + 1 < text.length() && text[i + 1] == '{');
+        size_t start = i + 1 + braced, end = start;
+        while (end < text.length() && is_name_char(text[end]))
+            end++;
+        if (end == start || isdigit((unsigned char) text[start])
+            || (braced && (end == text.length() || text[end] != '}')))
+        {
+            result += c;
+            continue;
+        }
+        NameIndex::const_iterator it =
+            this->m_index.find(text.substr(start, end - start));
+        if (it != this->m_index.end())
+            append_quoted(result, this->m_index.tag(*it), in_double);
+        i = end - 1 + braced;
+    }
+    return result;
+}
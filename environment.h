@@ -0,0 +1,45 @@
+/*
+    environment
+    ~~~~~~~~~~~
+
+    A sorted snapshot of the process environment, so completing a variable
+    name is a range lookup and expanding one does not read the environment
+    again.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_ENVIRONMENT_H
+#define TUDOR_DO_ENVIRONMENT_H
+#include <string>
+#include <vector>
+#include <glibmm.h>
+#include "index.h"
+
+class Environment
+{
+    public:
+        Environment();
+        virtual ~Environment();
+
+        // Rebuilds the snapshot from the process environment.
+        void refresh();
+        // Change the process environment and the snapshot together.
+        void set(const std::string& name, const std::string& value);
+        void unset(const std::string& name);
+
+        // Appends the names of the variables that start with |prefix|.
+        void complete(const std::string& prefix,
+                      std::vector<std::string>& names) const;
+        bool lookup(const std::string& name, std::string& value) const;
+        // Replaces $NAME and ${NAME} outside single quotes with the value
+        // of the variable, or with nothing if it is not set. Values are
+        // escaped, so quotes, backslashes or a '#' in them reach the
+        // tokenizer as plain characters.
+        std::string expand(const std::string& text) const;
+    protected:
+        NameIndex               m_index;    // the tag of a name is its value
+        mutable Glib::Mutex     m_mutex;
+};
+
+#endif /* TUDOR_DO_ENVIRONMENT_H */
@@ -0,0 +1,236 @@
+/*
+    fuzzy
+    ~~~~~
+
+    An fzf-style subsequence matcher. Candidates are first filtered by a
+    64-bit character bag, which is compared against many candidates at once
+    with SSE2 or AVX2 (picked at runtime); survivors are then scored with
+    bonuses for word boundaries, camelCase humps and contiguous runs.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <string>
+#include "fuzzy.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FUZZY_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const int SCORE_MATCH          = 16;
+    const int SCORE_GAP_START      = -3;
+    const int SCORE_GAP_EXTENSION  = -1;
+    const int BONUS_START          = 10;
+    const int BONUS_BOUNDARY       = 8;
+    const int BONUS_CAMEL          = 7;
+    const int BONUS_CONSECUTIVE    = 4;
+
+    typedef void (*filter_func)(const uint64_t*, size_t, uint64_t,
+                                std::vector<uint32_t>&);
+
+    inline char fold(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+
+    inline bool is_lower(char c) { return c >= 'a' && c <= 'z'; }
+    inline bool is_upper(char c) { return c >= 'A' && c <= 'Z'; }
+    inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    inline bool is_alnum(char c)
+    {
+        return is_lower(c) || is_upper(c) || is_digit(c);
+    }
+
+    inline int bag_bit(unsigned char c)
+    {
+        if (c >= 'a' && c <= 'z') return c - 'a';
+        if (c >= '0' && c <= '9') return 26 + (c - '0');
+        switch (c)
+        {
+            case '-': return 36;
+            case '_': return 37;
+            case '.': return 38;
+            case '+': return 39;
+        }
+        return 40 + c % 23;
+    }
+
+    int bonus_at(const char* str, size_t i)
+    {
+        if (i == 0) return BONUS_START;
+        char prev = str[i - 1], cur = str[i];
+        if (!is_alnum(prev))
+            return BONUS_BOUNDARY;
+        if ((is_lower(prev) && is_upper(cur))
+            || (!is_digit(prev) && is_digit(cur)))
+            return BONUS_CAMEL;
+        return 0;
+    }
+
+    // Finds the next occurrence of the lowercase character c, in either
+    // case, at or after |from|.
+    size_t find_folded(const char* str, size_t length, size_t from, char c)
+    {
+        char upper = is_lower(c) ? c - ('a' - 'A') : c;
+#ifdef __SSE2__
+        const __m128i lo = _mm_set1_epi8(c);
+        const __m128i up = _mm_set1_epi8(upper);
+        for (; from + 16 <= length; from += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*) (str + from));
+            int bits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lo),
+                                                      _mm_cmpeq_epi8(v, up)));
+            if (bits)
+                return from + __builtin_ctz(bits);
+        }
+#endif
+        for (; from < length; from++)
+            if (str[from] == c || str[from] == upper)
+                return from;
+        return std::string::npos;
+    }
+
+    void filter_scalar(const uint64_t* bags, size_t count, uint64_t mask,
+                       std::vector<uint32_t>& matches)
+    {
+        for (size_t i = 0; i < count; i++)
+            if ((bags[i] & mask) == mask)
+                matches.push_back(i);
+    }
+
+#ifdef FUZZY_X86
+    __attribute__((target("sse2")))
+    void filter_sse2(const uint64_t* bags, size_t count, uint64_t mask,
+                     std::vector<uint32_t>& matches)
+    {
+        // SSE2 has no 64-bit compare: a lane matches when both of its
+        // 32-bit halves do.
+        const __m128i m = _mm_set_epi64x(mask, mask);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*) (bags + i));
+            __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(v, m), m);
+            int bits = _mm_movemask_ps(_mm_castsi128_ps(eq));
+            if ((bits & 0x3) == 0x3) matches.push_back(i);
+            if ((bits & 0xc) == 0xc) matches.push_back(i + 1);
+        }
+        for (; i < count; i++)
+            if ((bags[i] & mask) == mask)
+                matches.push_back(i);
+    }
+
+    __attribute__((target("avx2")))
+    void filter_avx2(const uint64_t* bags, size_t count, uint64_t mask,
+                     std::vector<uint32_t>& matches)
+    {
+        const __m256i m = _mm256_set1_epi64x(mask);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i*) (bags + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*) (bags + i + 4));
+            a = _mm256_cmpeq_epi64(_mm256_and_si256(a, m), m);
+            b = _mm256_cmpeq_epi64(_mm256_and_si256(b, m), m);
+            int bits = _mm256_movemask_pd(_mm256_castsi256_pd(a))
+                     | _mm256_movemask_pd(_mm256_castsi256_pd(b)) << 4;
+            while (bits)
+            {
+                matches.push_back(i + __builtin_ctz(bits));
+                bits &= bits - 1;
+            }
+        }
+        for (; i < count; i++)
+            if ((bags[i] & mask) == mask)
+                matches.push_back(i);
+    }
+#endif
+
+    filter_func select_filter()
+    {
+#ifdef FUZZY_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return filter_avx2;
+        if (__builtin_cpu_supports("sse2"))
+            return filter_sse2;
+#endif
+        return filter_scalar;
+    }
+}
+
+FuzzyMatcher::FuzzyMatcher() : m_bag(FuzzyMatcher::BAG_LIVE)
+{
+}
+
+void FuzzyMatcher::set_query(const std::string& query)
+{
+    this->m_query.resize(query.length());
+    for (size_t i = 0; i < query.length(); i++)
+        this->m_query[i] = fold(query[i]);
+    this->m_bag = FuzzyMatcher::bag(this->m_query) | FuzzyMatcher::BAG_LIVE;
+}
+
+size_t FuzzyMatcher::filter(const uint64_t* bags, size_t count,
+                            std::vector<uint32_t>& matches) const
+{
+    static filter_func func = select_filter();
+    size_t before = matches.size();
+    func(bags, count, this->m_bag, matches);
+    return matches.size() - before;
+}
+
+int FuzzyMatcher::score(const char* str, size_t length) const
+{
+    const std::string& query = this->m_query;
+    if (query.empty()) return 0;
+    if (query.length() > length) return -1;
+
+    // Forward pass: find the earliest end of a full subsequence match.
+    size_t pos = 0;
+    for (size_t qi = 0; qi < query.length(); qi++, pos++)
+        if ((pos = find_folded(str, length, pos, query[qi]))
+            == std::string::npos)
+            return -1;
+    size_t end = pos;
+
+    // Backward pass: walk left from there to find the tightest window.
+    size_t start = end, qi = query.length();
+    while (qi > 0)
+        if (fold(str[--start]) == query[qi - 1])
+            qi--;
+
+    int score = 0;
+    bool in_gap = false, consecutive = false;
+    qi = 0;
+    for (size_t i = start; i < end && qi < query.length(); i++)
+    {
+        if (fold(str[i]) == query[qi])
+        {
+            score += SCORE_MATCH + bonus_at(str, i);
+            if (consecutive)
+                score += BONUS_CONSECUTIVE;
+            consecutive = true;
+            in_gap = false;
+            qi++;
+        }
+        else
+        {
+            score += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            consecutive = false;
+            in_gap = true;
+        }
+    }
+    return (score < 0) ? 0 : score;
+}
+
+uint64_t FuzzyMatcher::bag(const char* str, size_t length)
+{
+    uint64_t bag = 0;
+    for (size_t i = 0; i < length; i++)
+        bag |= 1ULL << bag_bit(fold(str[i]));
+    return bag;
+}
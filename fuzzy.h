@@ -0,0 +1,47 @@
+/*
+    fuzzy
+    ~~~~~
+
+    An fzf-style subsequence matcher. Candidates are first filtered by a
+    64-bit character bag, which is compared against many candidates at once
+    with SSE2 or AVX2 (picked at runtime); survivors are then scored with
+    bonuses for word boundaries, camelCase humps and contiguous runs.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_FUZZY_H
+#define TUDOR_DO_FUZZY_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class FuzzyMatcher
+{
+    public:
+        // Set on every live candidate bag, so empty slots never match.
+        static const uint64_t BAG_LIVE = 1ULL << 63;
+
+        FuzzyMatcher();
+        void set_query(const std::string& query);
+        inline const std::string& query() const { return this->m_query; }
+
+        size_t filter(const uint64_t* bags, size_t count,
+                      std::vector<uint32_t>& matches) const;
+        int score(const char* str, size_t length) const;
+        inline int score(const std::string& str) const
+        {
+            return this->score(str.data(), str.length());
+        }
+
+        static uint64_t bag(const char* str, size_t length);
+        inline static uint64_t bag(const std::string& str)
+        {
+            return FuzzyMatcher::bag(str.data(), str.length());
+        }
+    protected:
+        std::string     m_query;
+        uint64_t        m_bag;
+};
+
+#endif /* TUDOR_DO_FUZZY_H */
@@ -0,0 +1,342 @@
+/*
+    history
+    ~~~~~~~
+
+    The commands launched so far, kept sorted in memory with how often and
+    how recently each was launched, and persisted in an append-only log.
+    Every launch appends one line to the log from a writer thread, so the
+    UI never waits on the disk; the log is rewritten in compact form once
+    it has grown well past the commands it describes.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include "history.h"
+#include "util.h"
+
+namespace
+{
+    // Rough per-command cost of a map node on top of the command itself.
+    const size_t RECORD_OVERHEAD = 64;
+
+    // The log is compacted once it is this large and more than twice the
+    // size of the commands it holds.
+    const size_t COMPACT_MIN = 64 * 1024;
+
+    // Seconds after which a launch counts for half as much.
+    const double FRECENCY_HALF_LIFE = 7 * 24 * 3600;
+
+    inline double decay(double frecency, time_t elapsed)
+    {
+        return frecency * exp2(-elapsed / FRECENCY_HALF_LIFE);
+    }
+
+    bool write_all(int fd, const char* data, size_t length)
+    {
+        while (length > 0)
+        {
+            ssize_t n = write(fd, data, length);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    // Reads the decimal number at |p| and the blank after it.
+    bool read_number(const char*& p, const char* end, unsigned long long& n)
+    {
+        const char* start = p;
+        for (n = 0; p < end && *p >= '0' && *p <= '9'; p++)
+            n = n * 10 + (*p - '0');
+        if (p == start || p == end || *p != ' ')
+            return false;
+        p++;
+        return true;
+    }
+
+    // Reads the floating point number at |p| and the blank after it.
+    bool read_number(const char*& p, const char* end, double& n)
+    {
+        const char* blank = (const char*) memchr(p, ' ', end - p);
+        if (blank == NULL || blank == p || blank - p > 32)
+            return false;
+        char* stop;
+        std::string token(p, blank - p);
+        n = strtod(token.c_str(), &stop);
+        if (*stop != '\0' || !(n >= 0))
+            return false;
+        p = blank + 1;
+        return true;
+    }
+
+    // Every line of the log reads
+    // "<last launch> <count> <frecency at last launch> <command>".
+    void format_line(std::string& buffer, const std::string& command,
+                     time_t last, unsigned int count, double frecency)
+    {
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "%lld %u %.6g ", (long long) last,
+                 count, frecency);
+        buffer += prefix;
+        buffer += command;
+        buffer += '\n';
+    }
+
+    bool older(const std::pair<time_t, History::t_records::iterator>& a,
+               const std::pair<time_t, History::t_records::iterator>& b)
+    {
+        return a.first < b.first;
+    }
+}
+
+History::History(size_t budget) :
+m_budget(budget), m_bytes(0), m_fd(-1), m_log_bytes(0), m_thread(0),
+m_stop(false), m_generation(0)
+{
+}
+
+History::~History()
+{
+    this->stop();
+    if (this->m_thread)
+        this->m_thread->join();
+    // Whatever the writer did not get to.
+    if (this->m_fd != -1)
+    {
+        write_all(this->m_fd, this->m_queue.data(), this->m_queue.size());
+        close(this->m_fd);
+    }
+}
+
+std::string History::default_path()
+{
+    return Glib::build_filename(Glib::get_user_data_dir(),
+                                "tudor-do", "history");
+}
+
+bool History::open(const std::string& path)
+{
+    std::string dir = Glib::path_get_dirname(path);
+    if (g_mkdir_with_parents(dir.c_str(), 0700) == -1)
+    {
+        warning("cannot create history directory " + dir);
+        return false;
+    }
+    int fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+                    0600);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        warning("cannot open history " + path);
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+
+    Glib::Mutex::Lock lock(this->m_mutex);
+    if (st.st_size > 0)
+    {
+        void* map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            warning("cannot map history " + path);
+            close(fd);
+            return false;
+        }
+        const char* p = (const char*) map;
+        const char* end = p + st.st_size;
+        const char* eol;
+        // A line cut short by a crash has no newline and is skipped.
+        while ((eol = (const char*) memchr(p, '\n', end - p)) != NULL)
+        {
+            unsigned long long last, count;
+            double frecency;
+            if (read_number(p, eol, last) && read_number(p, eol, count)
+                && read_number(p, eol, frecency) && p < eol)
+                this->apply(std::string(p, eol - p), last, count, frecency);
+            p = eol + 1;
+        }
+        munmap(map, st.st_size);
+        // Keep the next line from being glued onto the cut one.
+        if (p != end)
+            this->m_queue += '\n';
+        this->trim();
+    }
+    this->m_path = path;
+    this->m_fd = fd;
+    this->m_log_bytes = st.st_size;
+    return true;
+}
+
+void History::start()
+{
+    this->m_thread = Glib::Thread::create(sigc::mem_fun(*this,
+        &History::run), true);
+}
+
+void History::stop()
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    this->m_stop = true;
+    this->m_cond.signal();
+}
+
+void History::add(const std::string& command)
+{
+    if (command.empty() || command.find('\n') != std::string::npos)
+        return;
+    time_t now = time(0);
+    Glib::Mutex::Lock lock(this->m_mutex);
+    this->apply(command, now, 1, 1.0);
+    this->trim();
+    format_line(this->m_queue, command, now, 1, 1.0);
+    g_atomic_int_inc(&this->m_generation);
+    this->m_cond.signal();
+}
+
+double History::frecency(const Record& record, time_t now)
+{
+    return decay(record.frecency, std::max(now - record.last, (time_t) 0));
+}
+
+History::t_range History::prefix_range(const std::string& prefix) const
+{
+    t_records::const_iterator first = this->m_records.lower_bound(prefix);
+
+    // Every command starting with |prefix| sorts before the smallest
+    // string that is greater than all of them.
+    std::string bound = prefix;
+    while (!bound.empty() && (unsigned char) bound[bound.length() - 1] == 0xff)
+        bound.erase(bound.length() - 1);
+    if (bound.empty())
+        return t_range(first, this->m_records.end());
+    bound[bound.length() - 1]++;
+    return t_range(first, this->m_records.lower_bound(bound));
+}
+
+void History::run()
+{
+    std::string lines;
+    while (true)
+    {
+        size_t live;
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            while (!this->m_stop && this->m_queue.empty())
+                this->m_cond.wait(this->m_mutex);
+            // Pending lines are still written after stop().
+            if (this->m_queue.empty())
+                break;
+            lines.swap(this->m_queue);
+            live = this->m_bytes;
+        }
+        if (this->m_fd == -1)
+            continue;
+
+        // Only this thread ever waits on the disk.
+        if (!write_all(this->m_fd, lines.data(), lines.size()))
+            warning("cannot append to history " + this->m_path);
+        fdatasync(this->m_fd);
+        this->m_log_bytes += lines.size();
+        lines.clear();
+        if (this->m_log_bytes > COMPACT_MIN && this->m_log_bytes > 2 * live)
+            this->compact();
+    }
+}
+
+void History::apply(const std::string& command, time_t last,
+                    unsigned int count, double frecency)
+{
+    std::pair<t_records::iterator, bool> inserted;
+    Record record = { last, 0, 0.0 };
+    inserted = this->m_records.insert(t_records::value_type(command, record));
+    if (inserted.second)
+        this->m_bytes += command.length() + RECORD_OVERHEAD;
+
+    // Both weights are brought to the later of the two times.
+    Record& found = inserted.first->second;
+    found.count += count;
+    if (last >= found.last)
+    {
+        found.frecency = decay(found.frecency, last - found.last) + frecency;
+        found.last = last;
+    }
+    else
+        found.frecency += decay(frecency, found.last - last);
+}
+
+void History::trim()
+{
+    if (this->m_bytes <= this->m_budget)
+        return;
+
+    // Go well below the budget so the next few launches do not trim again.
+    std::vector<std::pair<time_t, t_records::iterator> > order;
+    order.reserve(this->m_records.size());
+    for (t_records::iterator it = this->m_records.begin();
+         it != this->m_records.end();
+         ++it)
+        order.push_back(std::make_pair(it->second.last, it));
+    std::sort(order.begin(), order.end(), older);
+    for (size_t i = 0; i < order.size()
+         && this->m_bytes > this->m_budget / 4 * 3; i++)
+    {
+        this->m_bytes -= order[i].second->first.length() + RECORD_OVERHEAD;
+        this->m_records.erase(order[i].second);
+    }
+}
+
+bool History::compact()
+{
+    // Lines still queued are already part of the records, so they are
+    // taken along with the snapshot rather than appended twice.
+    std::string buffer, queued;
+    {
+        Glib::Mutex::Lock lock(this->m_mutex);
+        for (t_records::const_iterator it = this->m_records.begin();
+             it != this->m_records.end();
+             ++it)
+            format_line(buffer, it->first, it->second.last, it->second.count,
+                        it->second.frecency);
+        queued.swap(this->m_queue);
+    }
+
+    // Write a temporary file and rename it over the log, so a crash
+    // leaves either the old log or the new one.
+    std::string tmp = this->m_path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0600);
+    if (fd == -1
+        || !write_all(fd, buffer.data(), buffer.size())
+        || fdatasync(fd) == -1
+        || fcntl(fd, F_SETFL, O_APPEND) == -1
+        || rename(tmp.c_str(), this->m_path.c_str()) == -1)
+    {
+        warning("cannot compact history " + this->m_path);
+        if (fd != -1)
+            close(fd);
+        g_unlink(tmp.c_str());
+        // Keep appending to the old log instead.
+        Glib::Mutex::Lock lock(this->m_mutex);
+        this->m_queue.insert(0, queued);
+        return false;
+    }
+    close(this->m_fd);
+    this->m_fd = fd;
+    this->m_log_bytes = buffer.size();
+    return true;
+}
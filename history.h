@@ -0,0 +1,92 @@
+/*
+    history
+    ~~~~~~~
+
+    The commands launched so far, kept sorted in memory with how often and
+    how recently each was launched, and persisted in an append-only log.
+    Every launch appends one line to the log from a writer thread, so the
+    UI never waits on the disk; the log is rewritten in compact form once
+    it has grown well past the commands it describes.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_HISTORY_H
+#define TUDOR_DO_HISTORY_H
+#include <ctime>
+#include <map>
+#include <string>
+#include <glibmm.h>
+
+class History
+{
+    public:
+        struct Record
+        {
+            time_t          last;       // time of the latest launch
+            unsigned int    count;      // launches recorded
+            double          frecency;   // decayed launch count at |last|
+        };
+        typedef std::map<std::string, Record> t_records;
+        typedef std::pair<t_records::const_iterator,
+                          t_records::const_iterator> t_range;
+
+        // Keeps the records from changing while they are read.
+        class Lock
+        {
+            public:
+                Lock(const History& history) : m_lock(history.m_mutex) { }
+            protected:
+                Glib::Mutex::Lock m_lock;
+        };
+
+        // Commands beyond |budget| bytes are forgotten, least recently
+        // launched first.
+        History(size_t budget);
+        virtual ~History();
+
+        static std::string default_path();
+
+        // Loads the log at |path| and keeps appending to it.
+        bool open(const std::string& path);
+        void start();
+        void stop();
+
+        // Records a launch of |command| now.
+        void add(const std::string& command);
+        // Bumped by every add().
+        inline unsigned int generation() const
+        {
+            return g_atomic_int_get(&this->m_generation);
+        }
+
+        // Each launch counts for one at first and half as much for every
+        // half-life that has passed since.
+        static double frecency(const Record& record, time_t now);
+
+        // Both require a Lock to be held.
+        inline const t_records& records() const { return this->m_records; }
+        t_range prefix_range(const std::string& prefix) const;
+    protected:
+        size_t              m_budget;
+        size_t              m_bytes;        // memory used by m_records
+        t_records           m_records;
+        std::string         m_path;
+        int                 m_fd;
+        size_t              m_log_bytes;
+
+        Glib::Thread*       m_thread;
+        mutable Glib::Mutex m_mutex;
+        Glib::Cond          m_cond;
+        std::string         m_queue;        // lines not yet written
+        bool                m_stop;
+        gint                m_generation;
+
+        void run();
+        void apply(const std::string& command, time_t last,
+                   unsigned int count, double frecency);
+        void trim();
+        bool compact();
+};
+
+#endif /* TUDOR_DO_HISTORY_H */
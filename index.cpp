@@ -0,0 +1,135 @@
+/*
+    index
+    ~~~~~
+
+    A sorted, arena-backed index of names. Every name lives in a single
+    contiguous buffer, so a prefix query is a binary search down to a
+    contiguous range of entries.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <algorithm>
+#include <cstring>
+#include "index.h"
+
+namespace
+{
+    // Orders entries by the bytes they point to in the arena; a name that
+    // is a prefix of another sorts first.
+    struct EntryLess
+    {
+        const char* arena;
+
+        EntryLess(const char* base) : arena(base) { }
+
+        int compare(const NameIndex::Entry& entry, const char* key,
+                    size_t length) const
+        {
+            size_t n = std::min<size_t>(entry.length, length);
+            int res = memcmp(this->arena + entry.offset, key, n);
+            if (res != 0) return res;
+            return (entry.length < length) ? -1 : (entry.length > length);
+        }
+
+        bool operator()(const NameIndex::Entry& a,
+                        const NameIndex::Entry& b) const
+        {
+            return this->compare(a, this->arena + b.offset, b.length) < 0;
+        }
+
+        bool operator()(const NameIndex::Entry& a, const std::string& b) const
+        {
+            return this->compare(a, b.data(), b.length()) < 0;
+        }
+    };
+
+    // Compares only the first |prefix| bytes of an entry, so every entry
+    // that starts with the prefix is "equal" to it.
+    struct PrefixLess
+    {
+        const char* arena;
+
+        PrefixLess(const char* base) : arena(base) { }
+
+        bool operator()(const std::string& prefix,
+                        const NameIndex::Entry& entry) const
+        {
+            size_t n = std::min<size_t>(entry.length, prefix.length());
+            int res = memcmp(prefix.data(), this->arena + entry.offset, n);
+            if (res != 0) return res < 0;
+            return false;
+        }
+    };
+}
+
+NameIndex::NameIndex()
+{
+}
+
+void NameIndex::clear()
+{
+    this->m_arena.clear();
+    this->m_entries.clear();
+    this->m_tags.clear();
+}
+
+void NameIndex::reserve(size_t names, size_t bytes)
+{
+    this->m_entries.reserve(names);
+    this->m_arena.reserve(bytes + names);
+}
+
+uint32_t NameIndex::add_tag(const std::string& tag)
+{
+    this->m_tags.push_back(tag);
+    return this->m_tags.size() - 1;
+}
+
+void NameIndex::insert(const char* name, size_t length, uint32_t tag)
+{
+    Entry entry;
+    entry.offset = this->m_arena.size();
+    entry.length = length;
+    entry.tag    = tag;
+    this->m_arena.insert(this->m_arena.end(), name, name + length);
+    this->m_arena.push_back('\0');
+    this->m_entries.push_back(entry);
+}
+
+void NameIndex::insert(const std::string& name, uint32_t tag)
+{
+    this->insert(name.data(), name.length(), tag);
+}
+
+void NameIndex::sort()
+{
+    if (this->m_entries.empty()) return;
+    std::stable_sort(this->m_entries.begin(), this->m_entries.end(),
+                     EntryLess(&this->m_arena[0]));
+}
+
+NameIndex::range NameIndex::prefix_range(const std::string& prefix) const
+{
+    if (this->m_entries.empty())
+        return range(this->end(), this->end());
+    const char* arena = &this->m_arena[0];
+    const_iterator first = std::lower_bound(this->begin(), this->end(),
+                                            prefix, EntryLess(arena));
+    const_iterator last = std::upper_bound(first, this->end(), prefix,
+                                           PrefixLess(arena));
+    return range(first, last);
+}
+
+NameIndex::const_iterator NameIndex::find(const std::string& name) const
+{
+    if (this->m_entries.empty())
+        return this->end();
+    const char* arena = &this->m_arena[0];
+    const_iterator it = std::lower_bound(this->begin(), this->end(), name,
+                                         EntryLess(arena));
+    if (it == this->end() || it->length != name.length()
+        || memcmp(arena + it->offset, name.data(), name.length()) != 0)
+        return this->end();
+    return it;
+}
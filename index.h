@@ -0,0 +1,61 @@
+/*
+    index
+    ~~~~~
+
+    A sorted, arena-backed index of names. Every name lives in a single
+    contiguous buffer, so a prefix query is a binary search down to a
+    contiguous range of entries.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_INDEX_H
+#define TUDOR_DO_INDEX_H
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+class NameIndex
+{
+    public:
+        struct Entry
+        {
+            uint32_t offset;
+            uint32_t length;
+            uint32_t tag;
+        };
+        typedef std::vector<Entry>::const_iterator const_iterator;
+        typedef std::pair<const_iterator, const_iterator> range;
+
+        NameIndex();
+        void clear();
+        void reserve(size_t names, size_t bytes);
+        uint32_t add_tag(const std::string& tag);
+        void insert(const char* name, size_t length, uint32_t tag);
+        void insert(const std::string& name, uint32_t tag);
+        void sort();
+
+        range prefix_range(const std::string& prefix) const;
+        const_iterator find(const std::string& name) const;
+
+        inline const_iterator begin() const { return this->m_entries.begin(); }
+        inline const_iterator end() const { return this->m_entries.end(); }
+        inline size_t size() const { return this->m_entries.size(); }
+        inline bool empty() const { return this->m_entries.empty(); }
+
+        inline const char* name(const Entry& entry) const
+        {
+            return &this->m_arena[entry.offset];
+        }
+        inline const std::string& tag(const Entry& entry) const
+        {
+            return this->m_tags[entry.tag];
+        }
+    protected:
+        std::vector<char>           m_arena;
+        std::vector<Entry>          m_entries;
+        std::vector<std::string>    m_tags;
+};
+
+#endif /* TUDOR_DO_INDEX_H */
@@ -23,6 +23,7 @@
 
 
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <fstream>
@@ -263,14 +264,14 @@ void InotifyWatch::SetEnabled(bool fEnabled) throw (InotifyException)
         IN_WRITE_END_NOTHROW
         throw InotifyException(IN_EXC_MSG("enabling watch failed"), errno, this);
       }
-      m_pInotify->m_watches.insert(IN_WATCH_MAP::value_type(m_wd, this));
+      m_pInotify->m_watches.Insert(m_wd, this);
     }
     else {
       if (inotify_rm_watch(m_pInotify->GetDescriptor(), m_wd) != 0) {
         IN_WRITE_END_NOTHROW
         throw InotifyException(IN_EXC_MSG("disabling watch failed"), errno, this);
       }
-      m_pInotify->m_watches.erase(m_wd);
+      m_pInotify->m_watches.Erase(m_wd);
       m_wd = -1;
     }
   }
@@ -290,7 +291,7 @@ void InotifyWatch::__Disable()
   }
 
   if (m_pInotify != NULL) {
-    m_pInotify->m_watches.erase(m_wd);
+    m_pInotify->m_watches.Erase(m_wd);
     m_wd = -1;
   }
 
@@ -304,6 +305,9 @@ Inotify::Inotify() throw (InotifyException)
 {
   IN_LOCK_INIT
 
+  m_fOverflow = false;
+  m_buf.resize(INOTIFY_BUFLEN);
+
   m_fd = inotify_init();
   if (m_fd == -1) {
     IN_LOCK_DONE
@@ -376,7 +380,7 @@ void Inotify::Add(InotifyWatch* pWatch) throw (InotifyException)
     }
 
     pWatch->m_wd = wd;
-    m_watches.insert(IN_WATCH_MAP::value_type(pWatch->m_wd, pWatch));
+    m_watches.Insert(pWatch->m_wd, pWatch);
   }
 
   m_paths.insert(IN_WP_MAP::value_type(pWatch->m_path, pWatch));
@@ -385,6 +389,24 @@ void Inotify::Add(InotifyWatch* pWatch) throw (InotifyException)
   IN_WRITE_END
 }
 
+void Inotify::Adopt(InotifyWatch* pWatch, int32_t iDescriptor) throw (InotifyException)
+{
+  IN_WRITE_BEGIN
+
+  // this path or descriptor already watched - go away
+  if (FindWatch(pWatch->GetPath()) != NULL || FindWatch(iDescriptor) != NULL) {
+    IN_WRITE_END_NOTHROW
+    throw InotifyException(IN_EXC_MSG("path already watched"), EBUSY, this);
+  }
+
+  pWatch->m_wd = iDescriptor;
+  m_watches.Insert(pWatch->m_wd, pWatch);
+  m_paths.insert(IN_WP_MAP::value_type(pWatch->m_path, pWatch));
+  pWatch->m_pInotify = this;
+
+  IN_WRITE_END
+}
+
 void Inotify::Remove(InotifyWatch* pWatch) throw (InotifyException)
 {
   IN_WRITE_BEGIN
@@ -403,7 +425,7 @@ void Inotify::Remove(InotifyWatch* pWatch) throw (InotifyException)
       IN_WRITE_END_NOTHROW
       throw InotifyException(IN_EXC_MSG("removing watch failed"), errno, this);
     }
-    m_watches.erase(pWatch->m_wd);
+    m_watches.Erase(pWatch->m_wd);
     pWatch->m_wd = -1;
   }
 
@@ -428,7 +450,7 @@ void Inotify::RemoveAll()
     it++;
   }
 
-  m_watches.clear();
+  m_watches.Clear();
   m_paths.clear();
 
   IN_WRITE_END
@@ -439,7 +461,7 @@ void Inotify::WaitForEvents(bool fNoIntr) throw (InotifyException)
   ssize_t len = 0;
 
   do {
-    len = read(m_fd, m_buf, INOTIFY_BUFLEN);
+    len = read(m_fd, &m_buf[0], m_buf.size());
   } while (fNoIntr && len == -1 && errno == EINTR);
 
   if (len == -1 && !(errno == EWOULDBLOCK || errno == EINTR))
@@ -461,12 +483,66 @@ void Inotify::WaitForEvents(bool fNoIntr) throw (InotifyException)
         pW->__Disable();
       m_events.push_back(evt);
     }
+    else if (pEvt->wd == -1 && InotifyEvent::IsType(pEvt->mask, IN_Q_OVERFLOW))
+      m_fOverflow = true;
+    i += INOTIFY_EVENT_SIZE + (ssize_t) pEvt->len;
+  }
+
+  IN_WRITE_END
+}
+
+void Inotify::ReadEvents(std::vector<InotifyEventView>& rEvents, bool fNoIntr) throw (InotifyException)
+{
+  rEvents.clear();
+
+  ssize_t len = 0;
+
+  do {
+    len = read(m_fd, &m_buf[0], m_buf.size());
+  } while (fNoIntr && len == -1 && errno == EINTR);
+
+  if (len == -1 && !(errno == EWOULDBLOCK || errno == EINTR))
+    throw InotifyException(IN_EXC_MSG("reading events failed"), errno, this);
+
+  if (len == -1)
+    return;
+
+  IN_WRITE_BEGIN
+
+  ssize_t i = 0;
+  while (i < len) {
+    const struct inotify_event* pEvt = (const struct inotify_event*) &m_buf[i];
+    InotifyWatch* pW = FindWatch(pEvt->wd);
+    if (pW != NULL) {
+      InotifyEventView view;
+      view.m_pEvt = pEvt;
+      view.m_uNameLen = pEvt->len > 0 ? (uint32_t) strnlen(pEvt->name, pEvt->len) : 0;
+      view.m_pWatch = pW;
+      if (    InotifyEvent::IsType(pW->GetMask(), IN_ONESHOT)
+          ||  InotifyEvent::IsType(view.GetMask(), IN_IGNORED))
+        pW->__Disable();
+      rEvents.push_back(view);
+    }
+    else if (pEvt->wd == -1 && InotifyEvent::IsType(pEvt->mask, IN_Q_OVERFLOW))
+      m_fOverflow = true;
     i += INOTIFY_EVENT_SIZE + (ssize_t) pEvt->len;
   }
 
   IN_WRITE_END
 }
 
+bool Inotify::CheckOverflow()
+{
+  IN_WRITE_BEGIN
+
+  bool b = m_fOverflow;
+  m_fOverflow = false;
+
+  IN_WRITE_END
+
+  return b;
+}
+
 bool Inotify::GetEvent(InotifyEvent* pEvt) throw (InotifyException)
 {
   if (pEvt == NULL)
@@ -502,12 +578,48 @@ bool Inotify::PeekEvent(InotifyEvent* pEvt) throw (InotifyException)
   return b;
 }
 
+void InotifyWatchIndex::Insert(int32_t iDescriptor, InotifyWatch* pWatch)
+{
+  if (iDescriptor < 0 || pWatch == NULL)
+    return;
+
+  if (m_slots.empty()) {
+    m_base = iDescriptor;
+  }
+  else if (iDescriptor < m_base) {
+    m_slots.insert(m_slots.begin(), (size_t) (m_base - iDescriptor), (InotifyWatch*) NULL);
+    m_base = iDescriptor;
+  }
+  if (iDescriptor - m_base >= (int32_t) m_slots.size())
+    m_slots.resize(iDescriptor - m_base + 1, NULL);
+
+  InotifyWatch*& rSlot = m_slots[iDescriptor - m_base];
+  if (rSlot == NULL)
+    m_count++;
+  rSlot = pWatch;
+}
+
+void InotifyWatchIndex::Erase(int32_t iDescriptor)
+{
+  if (Find(iDescriptor) == NULL)
+    return;
+
+  m_slots[iDescriptor - m_base] = NULL;
+  m_count--;
+
+  while (!m_slots.empty() && m_slots.back() == NULL)
+    m_slots.pop_back();
+  while (!m_slots.empty() && m_slots.front() == NULL) {
+    m_slots.pop_front();
+    m_base++;
+  }
+}
+
 InotifyWatch* Inotify::FindWatch(int iDescriptor)
 {
   IN_READ_BEGIN
 
-  IN_WATCH_MAP::iterator it = m_watches.find(iDescriptor);
-  InotifyWatch* pW = it == m_watches.end() ? NULL : (*it).second;
+  InotifyWatch* pW = m_watches.Find(iDescriptor);
 
   IN_READ_END
 
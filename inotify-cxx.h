@@ -32,6 +32,8 @@
 #include <string>
 #include <deque>
 #include <map>
+#include <vector>
+#include <tr1/unordered_map>
 
 // Please ensure that the following header file takes the right place
 #include <sys/inotify.h>
@@ -41,7 +43,13 @@
 #define INOTIFY_EVENT_SIZE (sizeof(struct inotify_event))
 
 /// Event buffer length
-#define INOTIFY_BUFLEN (1024 * (INOTIFY_EVENT_SIZE + 16))
+/**
+ * Large enough for several thousand events with short names,
+ * so that a burst (e.g. a package upgrade) is read at once.
+ * The buffer is allocated on the heap, so an Inotify object
+ * can still live on a small thread stack.
+ */
+#define INOTIFY_BUFLEN (4096 * (INOTIFY_EVENT_SIZE + 48))
 
 /// Helper macro for creating exception messages.
 /**
@@ -371,6 +379,95 @@ private:
   InotifyWatch* m_pWatch;     ///< source watch
 };
 
+/// inotify event view class
+/**
+ * A lightweight view of an event inside the read buffer
+ * of an Inotify object. Nothing is copied or allocated;
+ * the view is valid only until the next call of
+ * Inotify::ReadEvents() or Inotify::WaitForEvents().
+ *
+ * \sa Inotify::ReadEvents()
+ */
+class InotifyEventView
+{
+public:
+  /// Constructor.
+  /**
+   * Creates an empty view.
+   */
+  InotifyEventView()
+  : m_pEvt(NULL),
+    m_uNameLen(0),
+    m_pWatch(NULL)
+  {
+  }
+
+  /// Returns the event mask.
+  /**
+   * \return event mask
+   */
+  inline uint32_t GetMask() const
+  {
+    return (uint32_t) m_pEvt->mask;
+  }
+
+  /// Checks for the event type.
+  /**
+   * \param[in] uType type which is checked for
+   * \return true = event mask contains the given type, false = otherwise
+   */
+  inline bool IsType(uint32_t uType) const
+  {
+    return InotifyEvent::IsType(GetMask(), uType);
+  }
+
+  /// Returns the event cookie.
+  /**
+   * \return event cookie
+   */
+  inline uint32_t GetCookie() const
+  {
+    return (uint32_t) m_pEvt->cookie;
+  }
+
+  /// Returns the event name.
+  /**
+   * The name is NUL-terminated and points into the read buffer.
+   *
+   * \return event name (empty if none)
+   */
+  inline const char* GetName() const
+  {
+    return m_uNameLen > 0 ? m_pEvt->name : "";
+  }
+
+  /// Returns the event name length.
+  /**
+   * \return event name length (without padding)
+   */
+  inline uint32_t GetLength() const
+  {
+    return m_uNameLen;
+  }
+
+  /// Returns the source watch.
+  /**
+   * \return source watch
+   */
+  inline InotifyWatch* GetWatch() const
+  {
+    return m_pWatch;
+  }
+
+private:
+  const struct inotify_event* m_pEvt; ///< raw event in the read buffer
+  uint32_t m_uNameLen;                ///< name length
+  InotifyWatch* m_pWatch;             ///< source watch
+
+  friend class Inotify;
+};
+
+
 
 
 /// inotify watch class
@@ -515,10 +612,74 @@ private:
 
 
 /// Mapping from watch descriptors to watch objects.
-typedef std::map<int32_t, InotifyWatch*> IN_WATCH_MAP;
+/**
+ * The kernel hands out small, increasing watch descriptors,
+ * so watches are kept in a deque indexed by descriptor and
+ * found in constant time. The deque only spans the range
+ * between the lowest and the highest live descriptor;
+ * empty slots at either end are dropped, so descriptors
+ * freed long ago take no space.
+ */
+class InotifyWatchIndex
+{
+public:
+  /// Constructor.
+  InotifyWatchIndex()
+  : m_base(0),
+    m_count(0)
+  {
+  }
+
+  /// Finds a watch by its descriptor.
+  /**
+   * \param[in] iDescriptor watch descriptor
+   * \return pointer to a watch; NULL if no such watch exists
+   */
+  inline InotifyWatch* Find(int32_t iDescriptor) const
+  {
+    if (iDescriptor < m_base || iDescriptor - m_base >= (int32_t) m_slots.size())
+      return NULL;
+    return m_slots[iDescriptor - m_base];
+  }
+
+  /// Stores a watch under its descriptor.
+  /**
+   * \param[in] iDescriptor watch descriptor (non-negative)
+   * \param[in] pWatch watch object
+   */
+  void Insert(int32_t iDescriptor, InotifyWatch* pWatch);
+
+  /// Forgets the watch stored under a descriptor.
+  /**
+   * \param[in] iDescriptor watch descriptor
+   */
+  void Erase(int32_t iDescriptor);
+
+  /// Forgets all watches.
+  inline void Clear()
+  {
+    m_slots.clear();
+    m_base = 0;
+    m_count = 0;
+  }
+
+  /// Returns the count of stored watches.
+  inline size_t Size() const
+  {
+    return m_count;
+  }
+
+private:
+  std::deque<InotifyWatch*> m_slots;  ///< watches from m_base on
+  int32_t m_base;                     ///< descriptor of the first slot
+  size_t m_count;                     ///< count of stored watches
+};
+
+/// Mapping from watch descriptors to watch objects.
+typedef InotifyWatchIndex IN_WATCH_MAP;
 
 /// Mapping from paths to watch objects.
-typedef std::map<std::string, InotifyWatch*> IN_WP_MAP;
+typedef std::tr1::unordered_map<std::string, InotifyWatch*> IN_WP_MAP;
 
 
 /// inotify class
@@ -568,6 +729,23 @@ public:
     Add(&rWatch);
   }
 
+  /// Adds a watch the kernel already knows.
+  /**
+   * Unlike Add() this does not call inotify_add_watch(); the
+   * watch descriptor has been obtained from it beforehand, on
+   * GetDescriptor(), possibly by another thread. Thus no path
+   * is looked up, which may block on a hung network mount.
+   * Events read before a descriptor is adopted are skipped
+   * like those of any unknown descriptor.
+   *
+   * \param[in] pWatch inotify watch (enabled)
+   * \param[in] iDescriptor watch descriptor
+   *
+   * 	hrow InotifyException thrown if the path or the descriptor
+   *                         is already watched
+   */
+  void Adopt(InotifyWatch* pWatch, int32_t iDescriptor) throw (InotifyException);
+
   /// Removes a watch.
   /**
    * If the given watch is not present it does nothing.
@@ -620,7 +798,7 @@ public:
   inline size_t GetEnabledCount() const
   {
     IN_READ_BEGIN
-    size_t n = (size_t) m_watches.size();
+    size_t n = m_watches.Size();
     IN_READ_END
     return n;
   }
@@ -639,6 +817,37 @@ public:
    */
   void WaitForEvents(bool fNoIntr = false) throw (InotifyException);
 
+  /// Reads a batch of inotify events without queueing them.
+  /**
+   * It works like WaitForEvents() but instead of copying
+   * the events into the internal queue it fills rEvents
+   * with views of the read buffer. The views are valid
+   * until the next call of this method or WaitForEvents().
+   * The vector is cleared first; its capacity is reused.
+   *
+   * \param[out] rEvents event views
+   * \param[in] fNoIntr if true it re-calls the system call after a handled signal
+   *
+   * \throw InotifyException thrown if reading events failed
+   *
+   * \sa WaitForEvents(), SetNonBlock()
+   */
+  void ReadEvents(std::vector<InotifyEventView>& rEvents, bool fNoIntr = false) throw (InotifyException);
+
+  /// Checks whether the kernel has dropped events.
+  /**
+   * When its event queue is full the kernel drops further
+   * events and reports it with an IN_Q_OVERFLOW event. That
+   * event belongs to no watch and is therefore neither queued
+   * nor passed to ReadEvents(); this method tells whether one
+   * has been read since the previous call.
+   *
+   * \return true if events have been lost, false otherwise
+   *
+   * \sa ReadEvents(), WaitForEvents()
+   */
+  bool CheckOverflow();
+
   /// Returns the count of received and queued events.
   /**
    * This number is related to the events in the queue inside
@@ -871,8 +1080,9 @@ private:
   int m_fd;                             ///< file descriptor
   IN_WATCH_MAP m_watches;               ///< watches (by descriptors)
   IN_WP_MAP m_paths;                    ///< watches (by paths)
-  unsigned char m_buf[INOTIFY_BUFLEN];  ///< buffer for events
+  std::vector<unsigned char> m_buf;     ///< buffer for events
   std::deque<InotifyEvent> m_events;    ///< event queue
+  bool m_fOverflow;                     ///< events lost since last check
 
   IN_LOCK_DECL
 
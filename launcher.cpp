@@ -0,0 +1,203 @@
+/*
+    launcher
+    ~~~~~~~~
+
+    Starts commands with posix_spawn, which shares the parent's address
+    space until the child calls exec instead of copying its page tables,
+    and keeps track of how long each launch took.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <cstring>
+#include <ctime>
+#include <signal.h>
+#include <spawn.h>
+#include <glibmm.h>
+#include "launcher.h"
+
+extern char** environ;
+
+namespace
+{
+    inline bool is_blank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n';
+    }
+
+    // Collects the exit status so finished children do not linger as
+    // zombies.
+    void reap(GPid pid, gint, gpointer)
+    {
+        g_spawn_close_pid(pid);
+    }
+}
+
+Launcher::Launcher() : m_zygote(0), m_mark(0)
+{
+    memset(&this->m_timing, 0, sizeof(this->m_timing));
+}
+
+Launcher::~Launcher()
+{
+}
+
+bool Launcher::tokenize(const std::string& command,
+                        std::vector<std::string>& argv, std::string& error)
+{
+    std::string word;
+    bool in_word = false;
+    argv.clear();
+    for (size_t i = 0; i < command.length(); i++)
+    {
+        char c = command[i];
+        if (is_blank(c))
+        {
+            if (in_word)
+                argv.push_back(word);
+            word.clear();
+            in_word = false;
+        }
+        else if (c == '#' && !in_word)
+            break;
+        else if (c == '\\')
+        {
+            in_word = true;
+            if (++i == command.length())
+                word += '\\';
+            else if (command[i] != '\n')
+                word += command[i];
+        }
+        else if (c == '\'')
+        {
+            size_t end = command.find('\'', i + 1);
+            if (end == std::string::npos)
+            {
+                error = "unterminated single quote";
+                return false;
+            }
+            word.append(command, i + 1, end - i - 1);
+            in_word = true;
+            i = end;
+        }
+        else if (c == '"')
+        {
+            // Inside double quotes a backslash only escapes the characters
+            // that would otherwise be special there.
+            for (i++; i < command.length() && command[i] != '"'; i++)
+            {
+                if (command[i] == '\\' && i + 1 < command.length()
+                    && strchr("\"\\$`\n", command[i + 1]))
+                {
+                    if (command[++i] != '\n')
+                        word += command[i];
+                }
+                else
+                    word += command[i];
+            }
+            if (i == command.length())
+            {
+                error = "unterminated double quote";
+                return false;
+            }
+            in_word = true;
+        }
+        else
+        {
+            word += c;
+            in_word = true;
+        }
+    }
+    if (in_word)
+        argv.push_back(word);
+    if (argv.empty())
+    {
+        error = "empty command";
+        return false;
+    }
+    return true;
+}
+
+void Launcher::mark()
+{
+    this->m_mark = Launcher::now();
+}
+
+bool Launcher::launch(const std::string& file,
+                      const std::vector<std::string>& argv,
+                      std::string& error)
+{
+    int64_t start = this->m_mark ? this->m_mark : Launcher::now();
+    this->m_mark = 0;
+
+    int err;
+    bool sent = false;
+    if (this->m_zygote && this->m_zygote->running())
+    {
+        std::vector<std::string> env;
+        for (char** var = environ; *var; var++)
+            env.push_back(*var);
+        sent = this->m_zygote->launch(file, argv, env,
+                                      Glib::get_current_dir(), err);
+    }
+    if (!sent)
+        err = Launcher::spawn(file, argv);
+    if (err != 0)
+    {
+        error = "cannot run " + file + ": " + strerror(err);
+        return false;
+    }
+
+    // Both paths only return once the child has exec'd, so this is the
+    // full Enter-to-exec latency.
+    int64_t elapsed = Launcher::now() - start;
+    this->m_timing.count++;
+    this->m_timing.last = elapsed;
+    this->m_timing.total += elapsed;
+    if (elapsed > this->m_timing.worst)
+        this->m_timing.worst = elapsed;
+    return true;
+}
+
+int Launcher::spawn(const std::string& file,
+                    const std::vector<std::string>& argv)
+{
+    std::vector<char*> args;
+    for (size_t i = 0; i < argv.size(); i++)
+        args.push_back(const_cast<char*>(argv[i].c_str()));
+    args.push_back(0);
+
+    // The child gets default signal dispositions and an empty signal
+    // mask rather than whatever GTK set up in this process.
+    sigset_t mask, defaults;
+    sigemptyset(&mask);
+    sigfillset(&defaults);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, flags);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    // posix_spawn only returns once the child has exec'd.
+    pid_t pid;
+    int err;
+    if (file.find('/') == std::string::npos)
+        err = posix_spawnp(&pid, file.c_str(), 0, &attr, &args[0], environ);
+    else
+        err = posix_spawn(&pid, file.c_str(), 0, &attr, &args[0], environ);
+    posix_spawnattr_destroy(&attr);
+    if (err == 0)
+        g_child_watch_add(pid, reap, 0);
+    return err;
+}
+
+int64_t Launcher::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,64 @@
+/*
+    launcher
+    ~~~~~~~~
+
+    Starts commands with posix_spawn, which shares the parent's address
+    space until the child calls exec instead of copying its page tables,
+    and keeps track of how long each launch took.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_LAUNCHER_H
+#define TUDOR_DO_LAUNCHER_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "zygote.h"
+
+class Launcher
+{
+    public:
+        // Launch latencies in microseconds, measured from mark() to the
+        // moment the child has called exec.
+        struct Timing
+        {
+            unsigned int    count;
+            int64_t         last;
+            int64_t         total;
+            int64_t         worst;
+        };
+
+        Launcher();
+        virtual ~Launcher();
+
+        // Splits |command| into words the way a shell would for a simple
+        // command: blanks separate words, quotes and backslashes protect
+        // them. Nothing is expanded.
+        static bool tokenize(const std::string& command,
+                             std::vector<std::string>& argv,
+                             std::string& error);
+
+        // Launches go through |zygote| while it is running; without one, or
+        // once it has gone away, they are spawned from this process.
+        inline void set_zygote(Zygote* zygote) { this->m_zygote = zygote; }
+
+        // Records the moment the user asked for a launch.
+        void mark();
+        // Runs |file| with |argv|; |file| is looked up in $PATH unless it
+        // contains a slash.
+        bool launch(const std::string& file,
+                    const std::vector<std::string>& argv,
+                    std::string& error);
+        inline const Timing& timing() const { return this->m_timing; }
+    protected:
+        Zygote*     m_zygote;
+        int64_t     m_mark;
+        Timing      m_timing;
+
+        static int spawn(const std::string& file,
+                         const std::vector<std::string>& argv);
+        static int64_t now();
+};
+
+#endif /* TUDOR_DO_LAUNCHER_H */
@@ -0,0 +1,62 @@
+/*
+    metadata
+    ~~~~~~~~
+
+    Remembers the file type and permission bits of directory entries by
+    device and inode, so a directory that is listed again does not have
+    to stat every entry a second time.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "metadata.h"
+
+MetadataCache::MetadataCache()
+{
+}
+
+MetadataCache::~MetadataCache()
+{
+}
+
+void MetadataCache::clear()
+{
+    this->m_entries.clear();
+}
+
+bool MetadataCache::lookup(uint64_t dev, uint64_t ino, uint32_t& mode) const
+{
+    Key key = { dev, ino };
+    std::tr1::unordered_map<Key, uint32_t, KeyHash>::const_iterator it;
+    if ((it = this->m_entries.find(key)) == this->m_entries.end())
+        return false;
+    mode = it->second;
+    return true;
+}
+
+void MetadataCache::store(uint64_t dev, uint64_t ino, uint32_t mode)
+{
+    Key key = { dev, ino };
+    this->m_entries[key] = mode;
+}
+
+bool MetadataCache::probe(int dirfd, const char* name,
+                          uint64_t& dev, uint64_t& ino, uint32_t& mode)
+{
+    struct stat st;
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+        return false;
+    dev  = st.st_dev;
+    ino  = st.st_ino;
+    mode = st.st_mode;
+    if (S_ISLNK(st.st_mode))
+        mode = (fstatat(dirfd, name, &st, 0) == -1) ? 0 : st.st_mode;
+    return true;
+}
+
+bool MetadataCache::is_executable(uint32_t mode)
+{
+    return S_ISREG(mode) && (mode & (S_IXUSR | S_IXGRP | S_IXOTH));
+}
@@ -0,0 +1,59 @@
+/*
+    metadata
+    ~~~~~~~~
+
+    Remembers the file type and permission bits of directory entries by
+    device and inode, so a directory that is listed again does not have
+    to stat every entry a second time.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_METADATA_H
+#define TUDOR_DO_METADATA_H
+#include <stdint.h>
+#include <tr1/unordered_map>
+
+class MetadataCache
+{
+    public:
+        MetadataCache();
+        virtual ~MetadataCache();
+        void clear();
+
+        // |mode| is the st_mode of the entry's target, or 0 for a
+        // dangling symlink.
+        bool lookup(uint64_t dev, uint64_t ino, uint32_t& mode) const;
+        void store(uint64_t dev, uint64_t ino, uint32_t mode);
+        inline size_t size() const { return this->m_entries.size(); }
+
+        // Stats |name| relative to the directory |dirfd|. The key is the
+        // entry's own device and inode, as getdents reports it; the mode
+        // is that of the file it resolves to.
+        static bool probe(int dirfd, const char* name,
+                          uint64_t& dev, uint64_t& ino, uint32_t& mode);
+        static bool is_executable(uint32_t mode);
+    protected:
+        struct Key
+        {
+            uint64_t dev;
+            uint64_t ino;
+
+            inline bool operator==(const Key& other) const
+            {
+                return this->ino == other.ino && this->dev == other.dev;
+            }
+        };
+
+        struct KeyHash
+        {
+            inline size_t operator()(const Key& key) const
+            {
+                return (size_t) (key.ino * 0x9e3779b97f4a7c15ULL ^ key.dev);
+            }
+        };
+
+        std::tr1::unordered_map<Key, uint32_t, KeyHash> m_entries;
+};
+
+#endif /* TUDOR_DO_METADATA_H */
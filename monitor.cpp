@@ -10,110 +10,906 @@
 */
 #include <iostream>
 #include <algorithm>
-#include "tudor-do.h"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include "util.h"
 #include "monitor.h"
+#include "scan.h"
 
-PathMonitor::PathMonitor(Do::t_path_map& path) :
-m_thread(0), m_stop(false), m_path(path)
+namespace
 {
+    const uint32_t WATCH_EVENTS = IN_CREATE | IN_DELETE | IN_MOVE |
+                                  IN_ATTRIB | IN_CLOSE_WRITE;
+
+    // Minimum number of seconds between two writes of the index cache.
+    const time_t CACHE_SAVE_INTERVAL = 5;
+
+    // Directory scans mostly wait on the disk, not the CPU.
+    const size_t SCAN_THREADS = 8;
+
+    // Entries stat'ed per batch before the trie is updated, so the lock is
+    // never held across disk I/O and the monitor can stop between batches.
+    const size_t VERIFY_BATCH = 256;
+
+    // Most change notifications sent to the UI per second; changes made
+    // in between are reported together.
+    const int NOTIFY_RATE = 4;
+    const int64_t NOTIFY_INTERVAL = 1000 / NOTIFY_RATE;
+
+    // Deltas queued for the main loop before it has to catch up with a
+    // reset, and how many it takes at a time.
+    const size_t DELTA_RING_SIZE = 4096;
+    const size_t DELTA_BATCH = 256;
+
+    inline int64_t now_ms()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    // Whether a d_type may name an executable. Only directories and
+    // special files can be ruled out without a stat.
+    inline bool maybe_executable(unsigned char type)
+    {
+        return type == DT_REG || type == DT_LNK || type == DT_UNKNOWN;
+    }
+
+    // A PATH candidate that has not been turned into a Completion yet.
+    struct Ranked
+    {
+        int         score;
+        uint32_t    length;
+        uint32_t    order;
+        uint32_t    leaf;
+    };
+
+    struct RankedBetter
+    {
+        bool operator()(const Ranked& a, const Ranked& b) const
+        {
+            if (a.score != b.score)
+                return a.score > b.score;
+            if (a.length != b.length)
+                return a.length < b.length;
+            return a.order < b.order;
+        }
+    };
+
+    void expand(const PathTrie& trie, TopK<Ranked, RankedBetter>& best,
+                std::vector<Completion>& results)
+    {
+        std::vector<Ranked> ranked;
+        best.take(ranked);
+        size_t limit = results.size() + best.limit();
+        for (size_t i = 0; i < ranked.size() && results.size() < limit; i++)
+        {
+            // A name is only offered from the directory that wins the
+            // PATH lookup; the other copies could never be run by name.
+            const PathTrie::Leaf& leaf = trie.leaf(ranked[i].leaf);
+            results.push_back(Completion(trie.directory(leaf.dirs.front()),
+                                         leaf.name, ranked[i].score));
+        }
+    }
+}
+
+PathMonitor::PathMonitor() :
+m_thread(0), m_stop(false), m_generation(0),
+m_cache_path(PathCache::default_path()), m_cache_open(false),
+m_cache_dirty(false), m_cache_saved(0), m_acquiring(0), m_previous(0),
+m_journal_mark(0), m_published(0), m_reset(false),
+m_deltas(DELTA_RING_SIZE), m_deltas_lost(0), m_deltas_armed(0)
+{
+    this->m_trie.set_journal(&this->m_journal);
+    this->m_snapshot = new Snapshot();
+    this->m_snapshot->trie = new PathTrie();
+    this->m_snapshot->generation = 0;
+    this->m_snapshot->refs = 0;
+    this->m_trie_users[this->m_snapshot->trie] = 1;
+    this->m_wakeup = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (this->m_wakeup == -1)
+        warning("cannot create eventfd; the monitor cannot be stopped");
+    this->m_deltas_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (this->m_deltas_fd == -1)
+        warning("cannot create eventfd; index changes go unreported");
 }
 
 PathMonitor::~PathMonitor()
 {
-    {
-        Glib::Mutex::Lock lock(this->m_mutex);
-        this->m_stop = true;
-    }
+    this->stop();
     if (this->m_thread)
         this->m_thread->join();
+    if (this->m_wakeup != -1)
+        close(this->m_wakeup);
+    this->m_deltas_source.disconnect();
+    if (this->m_deltas_fd != -1)
+        close(this->m_deltas_fd);
+    std::map<std::string, InotifyWatch*>::iterator it;
+    for (it = this->m_watches.begin(); it != this->m_watches.end(); ++it)
+        delete it->second;
+    // No query can be running once the monitor is destroyed.
+    delete this->m_snapshot;
+    for (size_t i = 0; i < this->m_retired.size(); i++)
+        delete this->m_retired[i];
+    std::map<const PathTrie*, unsigned int>::iterator trie;
+    for (trie = this->m_trie_users.begin();
+         trie != this->m_trie_users.end();
+         ++trie)
+        delete trie->first;
 }
 
 bool PathMonitor::monitor_directory(const std::string& path)
 {
     if (Glib::file_test(path, Glib::FILE_TEST_IS_DIR))
     {
-        this->m_watchlist.push_back(path);
+        this->control(true, path);
         return true;
     }
     return false;
 }
 
-bool PathMonitor::update_directory_listing(const std::string& path)
+void PathMonitor::unmonitor_directory(const std::string& path)
 {
-    if (Glib::file_test(path, Glib::FILE_TEST_IS_DIR))
+    this->control(false, path);
+}
+
+bool PathMonitor::update_directory_listings(
+    const std::vector<std::string>& paths)
+{
+    DirectoryScan scan(paths);
+    scan.run(SCAN_THREADS);
+
+    bool all = true;
+    std::string name;
+    Glib::Mutex::Lock lock(this->m_mutex);
+    for (size_t l = 0; l < scan.listings().size(); l++)
     {
-        Glib::Dir dir(path);
-        std::vector<std::string> listing(dir.begin(), dir.end());
+        const DirectoryScan::Listing& listing = scan.listings()[l];
+        if (!listing.ok)
         {
-            Glib::Mutex::Lock lock(this->m_mutex);
-            this->m_path[path] = listing;
+            all = false;
+            continue;
+        }
+        size_t known = this->m_trie.directory_count();
+        uint16_t id = this->m_trie.add_directory(listing.path);
+        if (id < known)
+            this->m_trie.remove_directory(id);
+        this->set_stamp(id, listing.stamp);
+        const char* names = listing.names.empty() ? 0 : &listing.names[0];
+        for (size_t i = 0, pos = 0; i < listing.count; i++)
+        {
+            name.assign(names + pos);
+            pos += name.length() + 1;
+            if (!maybe_executable(listing.types[i]))
+                continue;
+            uint32_t mode;
+            if (this->m_metadata.lookup(listing.dev, listing.inodes[i], mode))
+            {
+                if (MetadataCache::is_executable(mode))
+                    this->m_trie.insert(name, id);
+                continue;
+            }
+            Pending pending = { id, name };
+            this->m_pending.push_back(pending);
         }
     }
-    return false;
+    this->m_reset = true;
+    this->m_generation++;
+    this->m_cache_dirty = true;
+    // The monitor thread publishes the change, if it is running.
+    this->wake();
+    return all;
+}
+
+bool PathMonitor::restore_directory_listing(const std::string& path)
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    if (!this->m_cache_open)
+    {
+        this->m_cache.open(this->m_cache_path);
+        this->m_cache_open = true;
+    }
+    if (this->m_trie.find_directory(path) >= 0)
+        return false;
+    uint16_t id = this->m_trie.add_directory(path);
+    DirectoryStamp stamp;
+    if (!this->m_cache.restore(path, id, this->m_trie, stamp))
+        return false;
+    this->set_stamp(id, stamp);
+    this->m_reset = true;
+    this->m_generation++;
+    return true;
+}
+
+bool PathMonitor::resolve(const std::string& name, std::string& path)
+{
+    const Snapshot* snapshot = this->acquire();
+    const PathTrie::Leaf* leaf = snapshot->trie->find(name);
+    if (leaf)
+        path = Glib::build_filename(
+            snapshot->trie->directory(leaf->dirs.front()), name);
+    this->release(snapshot);
+    return leaf != 0;
+}
+
+unsigned int PathMonitor::generation()
+{
+    const Snapshot* snapshot = this->acquire();
+    unsigned int generation = snapshot->generation;
+    this->release(snapshot);
+    return generation;
+}
+
+void PathMonitor::set_boosts(const std::map<std::string, int>& boosts)
+{
+    Glib::Mutex::Lock lock(this->m_mutex);
+    // Boosts are recomputed every so often whether or not the history
+    // changed; the same boosts must not invalidate the frames built on
+    // the current generation.
+    if (boosts == this->m_boost_names)
+        return;
+    this->m_boost_names = boosts;
+    // Results computed with the old boosts are no longer valid.
+    this->m_generation++;
+    this->publish();
+}
+
+void PathMonitor::find_prefix(const std::string& prefix, size_t limit,
+                              const Candidates* narrow, Candidates& matched,
+                              std::vector<Completion>& results)
+{
+    TopK<Ranked, RankedBetter> best(limit);
+    const Snapshot* snapshot = this->acquire();
+    const PathTrie& trie = *snapshot->trie;
+    matched.generation = snapshot->generation;
+    matched.leaves.clear();
+    if (narrow && narrow->generation == snapshot->generation)
+    {
+        for (size_t i = 0; i < narrow->leaves.size(); i++)
+            if (trie.leaf(narrow->leaves[i]).name.compare(
+                    0, prefix.length(), prefix) == 0)
+                matched.leaves.push_back(narrow->leaves[i]);
+    }
+    else
+        trie.prefix(prefix, matched.leaves);
+
+    for (size_t i = 0; i < matched.leaves.size(); i++)
+    {
+        const std::string& name = trie.leaf(matched.leaves[i]).name;
+        Ranked ranked = { snapshot->boosts[matched.leaves[i]],
+                          (uint32_t) name.length(), (uint32_t) i,
+                          matched.leaves[i] };
+        best.push(ranked);
+    }
+    expand(trie, best, results);
+    this->release(snapshot);
+}
+
+void PathMonitor::find_fuzzy(const FuzzyMatcher& matcher, size_t limit,
+                             const Candidates* narrow, Candidates& matched,
+                             std::vector<Completion>& results)
+{
+    std::vector<uint32_t> leaves;
+    TopK<Ranked, RankedBetter> best(limit);
+    const Snapshot* snapshot = this->acquire();
+    const PathTrie& trie = *snapshot->trie;
+    if (narrow && narrow->generation == snapshot->generation)
+        leaves = narrow->leaves;
+    else
+        matcher.filter(trie.bags(), trie.capacity(), leaves);
+
+    matched.generation = snapshot->generation;
+    matched.leaves.clear();
+    for (size_t i = 0; i < leaves.size(); i++)
+    {
+        const std::string& name = trie.leaf(leaves[i]).name;
+        int score = matcher.score(name);
+        if (score < 0) continue;
+        matched.leaves.push_back(leaves[i]);
+        Ranked ranked = { score + snapshot->boosts[leaves[i]],
+                          (uint32_t) name.length(), leaves[i],
+                          leaves[i] };
+        best.push(ranked);
+    }
+    expand(trie, best, results);
+    this->release(snapshot);
+}
+
+void PathMonitor::publish()
+{
+    // Called with m_mutex held, so writers publish one at a time.
+    if (this->m_snapshot->generation == this->m_generation)
+        return;
+    Snapshot* snapshot = new Snapshot();
+    snapshot->generation = this->m_generation;
+    snapshot->refs = 0;
+    // Nothing was journaled since the last snapshot when only the boosts
+    // changed.
+    if (this->m_journal.size() == this->m_journal_mark)
+        snapshot->trie = this->m_snapshot->trie;
+    else
+        snapshot->trie = this->next_trie();
+    this->m_trie_users[snapshot->trie]++;
+
+    // Leaf ids change along with the index, so the boosts are looked up
+    // once per snapshot rather than once per candidate.
+    const PathTrie& trie = *snapshot->trie;
+    snapshot->boosts.assign(trie.capacity(), 0);
+    if (trie.capacity() > 0)
+    {
+        const PathTrie::Leaf* first = &trie.leaf(0);
+        std::map<std::string, int>::const_iterator it;
+        for (it = this->m_boost_names.begin();
+             it != this->m_boost_names.end();
+             ++it)
+        {
+            const PathTrie::Leaf* leaf = trie.find(it->first);
+            if (leaf)
+                snapshot->boosts[leaf - first] = it->second;
+        }
+    }
+
+    this->m_retired.push_back(this->m_snapshot);
+    g_atomic_pointer_set(&this->m_snapshot, snapshot);
+    this->reclaim();
+    this->send_deltas();
+}
+
+PathTrie* PathMonitor::next_trie()
+{
+    // Replaying beats copying unless most of the index changed.
+    PathTrie* trie;
+    PathTrie* spare = this->m_previous;
+    bool idle = spare && this->m_trie_users[spare] == 0;
+    if (idle && this->m_journal.size() <= this->m_trie.size())
+    {
+        trie = spare;
+        trie->replay(this->m_journal);
+    }
+    else
+    {
+        if (idle)
+        {
+            this->m_trie_users.erase(spare);
+            delete spare;
+        }
+        trie = new PathTrie(this->m_trie);
+        this->m_trie_users[trie] = 0;
+    }
+
+    // The current trie is the next to be recycled; all it lacks are the
+    // changes made since it was published.
+    this->m_journal.erase(this->m_journal.begin(),
+                          this->m_journal.begin() + this->m_journal_mark);
+    this->m_journal_mark = this->m_journal.size();
+    this->m_previous = this->m_snapshot->trie;
+    return trie;
+}
+
+void PathMonitor::send_deltas()
+{
+    if (!this->m_reset && this->m_touched.empty())
+        return;
+
+    // Each touched name is described by its state in the new snapshot,
+    // however often it changed in between.
+    bool sent = true;
+    Delta delta;
+    if (this->m_reset)
+    {
+        delta.kind = Delta::RESET;
+        sent = this->m_deltas.push(delta);
+    }
+    else
+    {
+        std::set<std::string>::const_iterator it;
+        for (it = this->m_touched.begin();
+             sent && it != this->m_touched.end();
+             ++it)
+        {
+            const PathTrie::Leaf* leaf = this->m_trie.find(*it);
+            delta.kind = leaf ? Delta::ADDED : Delta::REMOVED;
+            delta.name = *it;
+            delta.dir = leaf ? this->m_trie.directory(leaf->dirs.front())
+                             : std::string();
+            sent = this->m_deltas.push(delta);
+        }
+    }
+    // A full ring turns into a reset once the consumer catches up.
+    if (!sent)
+        g_atomic_int_set(&this->m_deltas_lost, 1);
+    this->m_touched.clear();
+    this->m_reset = false;
+
+    // Only the first batch since the consumer last drained the ring
+    // costs a write.
+    uint64_t one = 1;
+    if (this->m_deltas_fd != -1
+        && g_atomic_int_compare_and_exchange(&this->m_deltas_armed, 0, 1))
+        while (write(this->m_deltas_fd, &one, sizeof(one)) == -1
+               && errno == EINTR)
+            ;
+}
+
+bool PathMonitor::on_deltas(Glib::IOCondition)
+{
+    uint64_t value;
+    while (read(this->m_deltas_fd, &value, sizeof(value)) == -1
+           && errno == EINTR)
+        ;
+    // Disarm before draining, so a batch pushed meanwhile writes the
+    // eventfd again instead of going unnoticed.
+    g_atomic_int_set(&this->m_deltas_armed, 0);
+
+    t_deltas deltas;
+    while (this->m_deltas.pop(deltas, DELTA_BATCH) > 0)
+        ;
+    if (g_atomic_int_compare_and_exchange(&this->m_deltas_lost, 1, 0))
+    {
+        deltas.assign(1, Delta());
+        deltas[0].kind = Delta::RESET;
+    }
+    if (!deltas.empty())
+        this->sig_changed(deltas);
+    return true;
+}
+
+void PathMonitor::reclaim()
+{
+    // A reader that loaded a retired snapshot has either taken its
+    // reference by now or is still counted in m_acquiring; readers that
+    // start later only ever see the new snapshot.
+    if (g_atomic_int_get(&this->m_acquiring) != 0)
+        return;
+    std::vector<Snapshot*> held;
+    for (size_t i = 0; i < this->m_retired.size(); i++)
+    {
+        Snapshot* snapshot = this->m_retired[i];
+        if (g_atomic_int_get(&snapshot->refs) != 0)
+        {
+            held.push_back(snapshot);
+            continue;
+        }
+        // A trie nothing uses any more is kept only if it is the one
+        // next_trie() may recycle.
+        PathTrie* trie = snapshot->trie;
+        if (--this->m_trie_users[trie] == 0 && trie != this->m_previous)
+        {
+            this->m_trie_users.erase(trie);
+            delete trie;
+        }
+        delete snapshot;
+    }
+    this->m_retired.swap(held);
+}
+
+const PathMonitor::Snapshot* PathMonitor::acquire()
+{
+    g_atomic_int_inc(&this->m_acquiring);
+    Snapshot* snapshot = (Snapshot*) g_atomic_pointer_get(&this->m_snapshot);
+    g_atomic_int_inc(&snapshot->refs);
+    g_atomic_int_add(&this->m_acquiring, -1);
+    return snapshot;
+}
+
+void PathMonitor::release(const Snapshot* snapshot)
+{
+    // Only the writer frees snapshots, in reclaim().
+    g_atomic_int_add(&const_cast<Snapshot*>(snapshot)->refs, -1);
 }
 
 void PathMonitor::start()
 {
+    if (this->m_deltas_fd != -1)
+        this->m_deltas_source = Glib::signal_io().connect(sigc::mem_fun(
+            *this, &PathMonitor::on_deltas), this->m_deltas_fd, Glib::IO_IN);
     this->m_thread = Glib::Thread::create(sigc::mem_fun(*this,
         &PathMonitor::run), true);
 }
 
 void PathMonitor::stop()
 {
-    Glib::Mutex::Lock lock(this->m_mutex);
-    this->m_stop = true;
+    {
+        Glib::Mutex::Lock lock(this->m_mutex);
+        this->m_stop = true;
+    }
+    this->wake();
 }
 
-void PathMonitor::run()
+void PathMonitor::wake()
+{
+    uint64_t one = 1;
+    if (this->m_wakeup != -1)
+        while (write(this->m_wakeup, &one, sizeof(one)) == -1
+               && errno == EINTR)
+            ;
+}
+
+void PathMonitor::control(bool watch, const std::string& path)
+{
+    {
+        Glib::Mutex::Lock lock(this->m_mutex);
+        Control control = { watch, path };
+        this->m_controls.push_back(control);
+    }
+    this->wake();
+}
+
+bool PathMonitor::apply_controls(Inotify& notify)
 {
-    Inotify notify;
-    for (int i = 0; i < this->m_watchlist.size(); i++)
+    std::vector<Control> controls;
+    {
+        Glib::Mutex::Lock lock(this->m_mutex);
+        if (this->m_stop)
+            return false;
+        controls.swap(this->m_controls);
+    }
+
+    std::vector<std::string> stale;
+    for (size_t i = 0; i < controls.size(); i++)
+    {
+        const std::string& path = controls[i].path;
+        std::map<std::string, InotifyWatch*>::iterator it;
+        it = this->m_watches.find(path);
+        if (controls[i].watch)
+        {
+            if (it != this->m_watches.end())
+                continue;
+            InotifyWatch* watch = 0;
+            try
+            {
+                watch = new InotifyWatch(path, WATCH_EVENTS);
+                notify.Add(watch);
+                this->m_watches[path] = watch;
+            } catch (InotifyException) {
+                delete watch;
+                continue;
+            }
+
+            // Whatever changed before the watch was added went unnoticed,
+            // so a directory is listed again unless its names are known to
+            // be current: one that was never listed, unwatched since, or
+            // changed after it was read.
+            DirectoryStamp current;
+            current.read(path);
+            Glib::Mutex::Lock lock(this->m_mutex);
+            int dir = this->m_trie.find_directory(path);
+            if (dir < 0 || (size_t) dir >= this->m_stamps.size()
+                || !current.known() || this->m_stamps[dir] != current)
+                stale.push_back(path);
+            continue;
+        }
+
+        if (it == this->m_watches.end())
+            continue;
+        // No event still refers to the watch: they are all handled
+        // before controls are applied.
         try
         {
-            InotifyWatch* watch = new InotifyWatch(this->m_watchlist[i],
-                IN_CREATE | IN_DELETE | IN_MOVE);
-            watch->SetEnabled(true);
-            notify.Add(watch);
+            notify.Remove(it->second);
         } catch (InotifyException) { }
+        delete it->second;
+        this->m_watches.erase(it);
+
+        Glib::Mutex::Lock lock(this->m_mutex);
+        int dir = this->m_trie.find_directory(path);
+        if (dir < 0)
+            continue;
+        std::vector<Pending> pending;
+        for (size_t p = 0; p < this->m_pending.size(); p++)
+            if (this->m_pending[p].dir != dir)
+                pending.push_back(this->m_pending[p]);
+        this->m_pending.swap(pending);
+        this->m_trie.remove_directory(dir);
+        this->set_stamp(dir, DirectoryStamp());
+        this->m_reset = true;
+        this->m_generation++;
+        this->m_cache_dirty = true;
+    }
+    if (!stale.empty())
+        this->update_directory_listings(stale);
+    return true;
+}
+
+void PathMonitor::set_stamp(uint16_t dir, const DirectoryStamp& stamp)
+{
+    if (dir >= this->m_stamps.size())
+        this->m_stamps.resize(dir + 1);
+    this->m_stamps[dir] = stamp;
+}
+
+void PathMonitor::save_cache()
+{
+    std::string buffer;
+    {
+        Glib::Mutex::Lock lock(this->m_mutex);
+        if (!this->m_cache_dirty) return;
+        // A directory with names still to verify would be saved without
+        // them, yet under a stamp that passes for current.
+        std::vector<DirectoryStamp> stamps = this->m_stamps;
+        for (size_t i = 0; i < this->m_pending.size(); i++)
+            if (this->m_pending[i].dir < stamps.size())
+                stamps[this->m_pending[i].dir] = DirectoryStamp();
+        PathCache::serialize(this->m_trie, stamps, buffer);
+        this->m_cache_dirty = false;
+        this->m_cache_saved = time(0);
+    }
+    PathCache::write(this->m_cache_path, buffer);
+}
+
+void PathMonitor::verify_pending()
+{
+    std::vector<Pending> batch;
+    std::vector<std::string> paths;
+    while (true)
+    {
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            if (this->m_stop || this->m_pending.empty())
+                return;
+            size_t count = std::min(VERIFY_BATCH, this->m_pending.size());
+            batch.assign(this->m_pending.end() - count,
+                         this->m_pending.end());
+            this->m_pending.resize(this->m_pending.size() - count);
+            paths.resize(count);
+            for (size_t i = 0; i < count; i++)
+                paths[i] = this->m_trie.directory(batch[i].dir);
+        }
+
+        // Pending entries arrive grouped by directory, so the directory is
+        // only reopened when the batch moves on to the next one.
+        std::vector<uint64_t> devs(batch.size()), inodes(batch.size());
+        std::vector<uint32_t> modes(batch.size());
+        std::vector<bool> found(batch.size());
+        int dirfd = -1;
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (i == 0 || batch[i].dir != batch[i - 1].dir)
+            {
+                if (dirfd != -1) close(dirfd);
+                dirfd = open(paths[i].c_str(),
+                             O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            }
+            found[i] = dirfd != -1 && MetadataCache::probe(dirfd,
+                batch[i].name.c_str(), devs[i], inodes[i], modes[i]);
+        }
+        if (dirfd != -1) close(dirfd);
+
+        bool changed = false;
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                if (found[i])
+                    this->m_metadata.store(devs[i], inodes[i], modes[i]);
+                bool touched;
+                if (found[i] && MetadataCache::is_executable(modes[i]))
+                    touched = this->m_trie.insert(batch[i].name,
+                                                  batch[i].dir);
+                else
+                    touched = this->m_trie.remove(batch[i].name,
+                                                  batch[i].dir);
+                if (touched)
+                    this->m_touched.insert(batch[i].name);
+                changed |= touched;
+            }
+            if (changed)
+            {
+                this->m_generation++;
+                this->m_cache_dirty = true;
+            }
+            // A cold start verifies every rescanned name; what has been
+            // verified so far is completed on meanwhile.
+            int64_t now = now_ms();
+            if (now - this->m_published >= NOTIFY_INTERVAL)
+            {
+                this->publish();
+                this->m_published = now;
+            }
+        }
+    }
+}
+
+void PathMonitor::run()
+{
+    {
+        Glib::Mutex::Lock lock(this->m_mutex);
+        this->m_cache.close();
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1)
+    {
+        warning("cannot create epoll instance");
+        return;
+    }
     try
     {
-        while (true) {
+        Inotify notify;
+        notify.SetNonBlock(true);
+        notify.SetCloseOnExec(true);
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = notify.GetDescriptor();
+        epoll_ctl(epfd, EPOLL_CTL_ADD, event.data.fd, &event);
+        if (this->m_wakeup != -1)
+        {
+            event.data.fd = this->m_wakeup;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, event.data.fd, &event);
+        }
+
+        // Queries can start on what the initial scan found. Directories
+        // are watched before the names it queued are verified, so no
+        // change in between goes unnoticed.
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            this->publish();
+        }
+        bool running = this->apply_controls(notify);
+        if (running)
+            this->verify_pending();
+        while (running)
+        {
+            // Changes, whichever thread made them, are published and
+            // announced at most NOTIFY_RATE times a second. Sleep until
+            // something happens, unless that or a cache write is due.
+            int timeout = -1;
             {
                 Glib::Mutex::Lock lock(this->m_mutex);
-                if (this->m_stop)
-                    break;
+                if (this->m_snapshot->generation != this->m_generation)
+                {
+                    int64_t elapsed = now_ms() - this->m_published;
+                    if (elapsed >= NOTIFY_INTERVAL)
+                    {
+                        this->publish();
+                        this->m_published += elapsed;
+                    }
+                    else
+                        timeout = NOTIFY_INTERVAL - elapsed;
+                }
+                if (this->m_cache_dirty)
+                {
+                    int due = std::max((time_t) 0, this->m_cache_saved
+                        + CACHE_SAVE_INTERVAL - time(0)) * 1000;
+                    timeout = (timeout == -1) ? due : std::min(timeout, due);
+                }
             }
-            notify.WaitForEvents();
-            size_t count = notify.GetEventCount();
-            while (count > 0)
+            struct epoll_event events[2];
+            int count = epoll_wait(epfd, events, 2, timeout);
+            if (count == -1 && errno != EINTR)
             {
-                InotifyEvent event;
-                bool got_event = notify.GetEvent(&event);
-
-                if (got_event)
+                warning(std::string("epoll_wait failed: ") + strerror(errno));
+                break;
+            }
+            for (int i = 0; i < count; i++)
+            {
+                if (events[i].data.fd == this->m_wakeup)
                 {
-                    const std::string directory = event.GetWatch()->GetPath();
-
-                    Glib::Mutex::Lock lock(this->m_mutex);
-                    if (event.IsType(IN_CREATE) ||
-                        event.IsType(IN_MOVED_TO))
-                        this->m_path[directory].push_back(event.GetName());
-                    else if (event.IsType(IN_DELETE) ||
-                             event.IsType(IN_MOVED_FROM))
-                        this->m_path[directory].erase(
-                            ++find(
-                                this->m_path[directory].begin(),
-                                this->m_path[directory].end(),
-                                event.GetName()
-                            )
-                        );
-                    this->sig_changed();
+                    uint64_t value;
+                    while (read(this->m_wakeup, &value, sizeof(value)) == -1
+                           && errno == EINTR)
+                        ;
                 }
-                count--;
+                else
+                    this->read_events(notify);
             }
+            this->verify_pending();
+            if (time(0) - this->m_cache_saved >= CACHE_SAVE_INTERVAL)
+                this->save_cache();
+            running = this->apply_controls(notify);
         }
     } catch(InotifyException &e) {
         warning(e.GetMessage());
     }
+    close(epfd);
+    this->save_cache();
+}
+
+void PathMonitor::read_events(Inotify& notify)
+{
+    // Only the last event for a name counts: whether the name is gone, or
+    // has to be checked. A file created and deleted within one batch, as
+    // during a package upgrade, never reaches the index, and a file
+    // written in several steps is checked once.
+    typedef std::map<std::pair<InotifyWatch*, std::string>, bool> t_batch;
+    t_batch gone;
+    std::map<InotifyWatch*, DirectoryStamp> stamps;
+    std::vector<InotifyEventView> events;
+    std::string name;
+    while (true)
+    {
+        // The descriptor is non-blocking; an empty read ends the loop.
+        bool drained = false;
+        for (notify.ReadEvents(events);
+             !events.empty();
+             notify.ReadEvents(events))
+        {
+            drained = true;
+            for (size_t i = 0; i < events.size(); i++)
+            {
+                const InotifyEventView& event = events[i];
+                if (event.GetLength() == 0)
+                    continue;
+                name.assign(event.GetName(), event.GetLength());
+                gone[std::make_pair(event.GetWatch(), name)] =
+                    event.IsType(IN_DELETE) || event.IsType(IN_MOVED_FROM);
+            }
+        }
+        if (!drained)
+            break;
+
+        // A stamp may only cover changes whose events are applied along
+        // with it, so every changed directory is stamped before the queue
+        // is drained once more. A change made after that leaves the stamp
+        // older than the directory, which merely costs a rescan.
+        for (t_batch::const_iterator it = gone.begin(); it != gone.end(); ++it)
+            if (stamps.find(it->first.first) == stamps.end())
+                stamps[it->first.first].read(it->first.first->GetPath());
+    }
+
+    // The kernel dropped events, so there is no telling which names
+    // changed: every watched directory is listed again, which also sends
+    // queries a reset. A lost IN_ATTRIB may have left a cached mode
+    // stale, so every name is checked afresh.
+    if (notify.CheckOverflow())
+    {
+        warning("inotify queue overflowed, rescanning $PATH");
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            this->m_metadata.clear();
+        }
+        std::vector<std::string> paths;
+        std::map<std::string, InotifyWatch*>::const_iterator it;
+        for (it = this->m_watches.begin(); it != this->m_watches.end(); ++it)
+            paths.push_back(it->first);
+        this->update_directory_listings(paths);
+        return;
+    }
+    if (gone.empty())
+        return;
+
+    // The batch is sorted by watch, so each directory is looked up once.
+    bool changed = false;
+    InotifyWatch* watch = 0;
+    int dir = -1;
+    Glib::Mutex::Lock lock(this->m_mutex);
+    for (t_batch::const_iterator it = gone.begin(); it != gone.end(); ++it)
+    {
+        if (it->first.first != watch)
+        {
+            watch = it->first.first;
+            dir = this->m_trie.find_directory(watch->GetPath());
+            if (dir >= 0)
+                this->set_stamp(dir, stamps[watch]);
+        }
+        if (dir < 0)
+            continue;
+        // New or modified entries are only indexed once they are known to
+        // be executable.
+        if (it->second)
+        {
+            if (this->m_trie.remove(it->first.second, dir))
+            {
+                this->m_touched.insert(it->first.second);
+                changed = true;
+            }
+        }
+        else
+        {
+            Pending pending = { (uint16_t) dir, it->first.second };
+            this->m_pending.push_back(pending);
+        }
+    }
+    // The stamps moved on, even if no name did.
+    this->m_cache_dirty = true;
+    if (changed)
+        this->m_generation++;
 }
@@ -3,32 +3,169 @@
     ~~~~~~~
 
     Handles monitoring of directories in $PATH for changes and updates
-    directory listings of them.
+    directory listings of them. The monitor thread sleeps in epoll on its
+    inotify descriptor and an eventfd, through which other threads ask it
+    to watch or unwatch directories, or to stop.
+
+    Queries never see the index being changed: writers work on their own
+    copy under a mutex and publish immutable snapshots of it, which
+    readers pick up without locking. What changed between two snapshots
+    reaches the GTK main loop as a batch of deltas, through a lock-free
+    ring and a single eventfd.
 
     :copyright: (c) 2010 David 'dav' Gidwani
     :license: New BSD License. See LICENSE for details.
 */
 #ifndef TUDOR_DO_MONITOR_H
 #define TUDOR_DO_MONITOR_H
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include <glibmm.h>
+#include "cache.h"
+#include "fuzzy.h"
 #include "inotify-cxx.h"
-#include "tudor-do.h"
+#include "metadata.h"
+#include "results.h"
+#include "ring.h"
+#include "trie.h"
 
 class PathMonitor
 {
     public:
-        Glib::Dispatcher sig_changed;
+        // Every leaf a query matched, tagged with the index generation it
+        // was computed against. A query that refines an earlier one only
+        // has to look at the earlier candidates.
+        struct Candidates
+        {
+            unsigned int            generation;
+            std::vector<uint32_t>   leaves;
+
+            Candidates() : generation(0) { }
+        };
+
+        // A change to the published index. RESET means too much changed
+        // to describe name by name.
+        struct Delta
+        {
+            enum Kind
+            {
+                ADDED,      // |name| now runs from |dir|
+                REMOVED,    // |name| is gone
+                RESET
+            };
+
+            Kind            kind;
+            std::string     name;
+            std::string     dir;
+        };
+        typedef std::vector<Delta> t_deltas;
 
-        PathMonitor(Do::t_path_map& path);
+        // Emitted on the main loop once changes have been published, at
+        // most a few times a second, with everything that changed since.
+        sigc::signal<void, const t_deltas&> sig_changed;
+
+        PathMonitor();
         virtual ~PathMonitor();
+        // Both take effect on the monitor thread, once it runs. A directory
+        // is listed once watched, unless its listing is known to be
+        // current.
         bool monitor_directory(const std::string& path);
-        bool update_directory_listing(const std::string& path);
+        // Also drops the directory's names from the index.
+        void unmonitor_directory(const std::string& path);
+        bool update_directory_listings(const std::vector<std::string>& paths);
+        bool restore_directory_listing(const std::string& path);
+        // Queries: these read the latest published snapshot and never
+        // wait for a writer.
+        // Finds the file a PATH lookup of |name| would run.
+        bool resolve(const std::string& name, std::string& path);
+        unsigned int generation();
+        // Adds |boosts|, by name, to the score of every match from now on.
+        // Boosts equal to the current ones change nothing.
+        void set_boosts(const std::map<std::string, int>& boosts);
+        void find_prefix(const std::string& prefix, size_t limit,
+                         const Candidates* narrow, Candidates& matched,
+                         std::vector<Completion>& results);
+        void find_fuzzy(const FuzzyMatcher& matcher, size_t limit,
+                        const Candidates* narrow, Candidates& matched,
+                        std::vector<Completion>& results);
+        // Also attaches the delta source to the default main context, so
+        // it has to be called from the main loop's thread.
         void start();
         void stop();
     protected:
-        Do::t_path_map&              m_path;
-        std::vector<std::string>     m_watchlist;
+        // An immutable view of the index. A snapshot is freed by the
+        // writer once it has been replaced and no reader holds it. Its
+        // trie is shared with the snapshots before it as long as only the
+        // boosts changed.
+        struct Snapshot
+        {
+            PathTrie*                trie;
+            std::vector<int>         boosts;         // by leaf
+            unsigned int             generation;
+            gint                     refs;
+        };
+
+        // The writers' copy of the index, guarded by m_mutex.
+        PathTrie                     m_trie;
+        unsigned int                 m_generation;
+        Snapshot*                    m_snapshot;
+        // Readers between loading m_snapshot and taking a reference.
+        gint                         m_acquiring;
+        std::vector<Snapshot*>       m_retired;
+        // Snapshots per published trie, current or retired.
+        std::map<const PathTrie*, unsigned int> m_trie_users;
+        // Rather than copying m_trie for every snapshot, the trie published
+        // before the current one is brought up to date once no snapshot
+        // uses it, by replaying the changes m_trie has gone through since.
+        // Those made since the current trie was published start at
+        // m_journal_mark.
+        PathTrie*                    m_previous;
+        PathTrie::t_journal          m_journal;
+        size_t                       m_journal_mark;
+        // When the monitor thread last published, in monotonic ms.
+        int64_t                      m_published;
+        // An entry whose type and mode still have to be checked before
+        // it may be indexed (or after which it may have to be dropped).
+        struct Pending
+        {
+            uint16_t                 dir;
+            std::string              name;
+        };
+
+        MetadataCache                m_metadata;
+        std::vector<Pending>         m_pending;
+        // By directory id: the directory as its names in m_trie describe
+        // it, or an unknown stamp if they may not.
+        std::vector<DirectoryStamp>  m_stamps;
+        PathCache                    m_cache;
+        std::string                  m_cache_path;
+        bool                         m_cache_open;
+        bool                         m_cache_dirty;
+        time_t                       m_cache_saved;
+        // A watch change requested from another thread. Only the monitor
+        // thread touches its inotify instance and m_watches.
+        struct Control
+        {
+            bool                     watch;
+            std::string              path;
+        };
+        std::vector<Control>         m_controls;
+        std::map<std::string, InotifyWatch*> m_watches;
+        int                          m_wakeup;       // eventfd
+        std::map<std::string, int>   m_boost_names;
+
+        // Names changed since the last snapshot, or a reset. Publishers
+        // turn them into deltas; being serialized by m_mutex, they act as
+        // the ring's single producer.
+        std::set<std::string>        m_touched;
+        bool                         m_reset;
+        SpscRing<Delta>              m_deltas;
+        gint                         m_deltas_lost;
+        gint                         m_deltas_armed;
+        int                          m_deltas_fd;    // eventfd
+        sigc::connection             m_deltas_source;
 
         Glib::Thread*                m_thread;
         Glib::Mutex                  m_mutex;
@@ -36,6 +173,20 @@ class PathMonitor
         bool                         m_stop;
 
         void run();
+        void wake();
+        void control(bool watch, const std::string& path);
+        bool apply_controls(Inotify& notify);
+        void read_events(Inotify& notify);
+        void set_stamp(uint16_t dir, const DirectoryStamp& stamp);
+        void save_cache();
+        void verify_pending();
+        void publish();
+        PathTrie* next_trie();
+        void send_deltas();
+        bool on_deltas(Glib::IOCondition condition);
+        void reclaim();
+        const Snapshot* acquire();
+        void release(const Snapshot* snapshot);
 };
 
 #endif /* TUDOR_DO_MONITOR_H */
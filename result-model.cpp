@@ -0,0 +1,236 @@
+/*
+    result-model
+    ~~~~~~~~~~~~
+
+    A flat Gtk::TreeModel that serves the completer's result array as is,
+    instead of copying every result into a Gtk::ListStore.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <algorithm>
+#include <map>
+#include "result-model.h"
+
+namespace
+{
+    // Rows show the name and directory only, and no two rows show the
+    // same.
+    typedef std::pair<std::string, std::string> t_key;
+
+    inline t_key row_key(const Completion& completion)
+    {
+        return t_key(completion.dir, completion.name);
+    }
+}
+
+ResultModel::ResultModel() :
+Glib::ObjectBase(typeid(ResultModel)), Glib::Object(), m_size(0), m_stamp(1)
+{
+}
+
+ResultModel::~ResultModel()
+{
+}
+
+Glib::RefPtr<ResultModel> ResultModel::create()
+{
+    return Glib::RefPtr<ResultModel>(new ResultModel());
+}
+
+void ResultModel::set_results(std::vector<Completion>& results)
+{
+    // Rows that are in both lists, in the same order, stay where they are;
+    // views are only told about the rows that went away or appeared.
+    int old_size = this->m_rows.size(), new_size = results.size();
+    std::map<t_key, int> positions;
+    for (int row = 0; row < new_size; row++)
+        positions.insert(std::make_pair(row_key(results[row]), row));
+
+    // Of the old rows still there, the longest run whose new positions
+    // increase is kept, found by patience sorting; a row that moved
+    // against it is deleted and inserted again.
+    std::vector<int> moved(old_size, -1), previous(old_size, -1);
+    std::vector<int> tails, tail_rows;
+    for (int row = 0; row < old_size; row++)
+    {
+        std::map<t_key, int>::const_iterator found;
+        found = positions.find(row_key(this->m_rows[row]));
+        if (found == positions.end())
+            continue;
+        moved[row] = found->second;
+        size_t k = std::lower_bound(tails.begin(), tails.end(), moved[row])
+                   - tails.begin();
+        if (k == tails.size())
+        {
+            tails.push_back(moved[row]);
+            tail_rows.push_back(row);
+        }
+        else
+        {
+            tails[k] = moved[row];
+            tail_rows[k] = row;
+        }
+        previous[row] = (k > 0) ? tail_rows[k - 1] : -1;
+    }
+
+    std::vector<bool> kept(old_size, false), added(new_size, true);
+    for (int row = tail_rows.empty() ? -1 : tail_rows.back();
+         row >= 0;
+         row = previous[row])
+    {
+        kept[row] = true;
+        added[moved[row]] = false;
+    }
+
+    // Delete from the end, so the rows before each deleted one keep their
+    // paths, then insert in order, so each new row lands at its final
+    // position. Every row a view can see has data throughout.
+    iterator iter;
+    for (int row = old_size - 1; row >= 0; row--)
+    {
+        if (kept[row])
+            continue;
+        this->m_rows.erase(this->m_rows.begin() + row);
+        this->m_size = this->m_rows.size();
+        Path path;
+        path.push_back(row);
+        this->row_deleted(path);
+    }
+    for (int row = 0; row < new_size; row++)
+    {
+        if (!added[row])
+        {
+            this->m_rows[row].score = results[row].score;
+            continue;
+        }
+        this->m_rows.insert(this->m_rows.begin() + row, results[row]);
+        this->m_size = this->m_rows.size();
+        Path path;
+        path.push_back(row);
+        this->set_row(iter, row);
+        this->row_inserted(path, iter);
+    }
+    results.clear();
+}
+
+void ResultModel::set_row(iterator& iter, int row) const
+{
+    iter.set_stamp(this->m_stamp);
+    iter.gobj()->user_data = GINT_TO_POINTER(row);
+}
+
+int ResultModel::get_row(const iterator& iter) const
+{
+    if (iter.get_stamp() != this->m_stamp)
+        return -1;
+    int row = GPOINTER_TO_INT(iter.gobj()->user_data);
+    return (row >= 0 && row < this->m_size) ? row : -1;
+}
+
+Gtk::TreeModelFlags ResultModel::get_flags_vfunc() const
+{
+    return Gtk::TREE_MODEL_LIST_ONLY;
+}
+
+int ResultModel::get_n_columns_vfunc() const
+{
+    return COLUMN_COUNT;
+}
+
+GType ResultModel::get_column_type_vfunc(int) const
+{
+    return Glib::Value<Glib::ustring>::value_type();
+}
+
+void ResultModel::get_value_vfunc(const iterator& iter, int column,
+                                  Glib::ValueBase& value) const
+{
+    int row = this->get_row(iter);
+    if (row < 0 || column < 0 || column >= COLUMN_COUNT)
+        return;
+
+    const Completion& completion = this->m_rows[row];
+    Glib::Value<Glib::ustring> text;
+    text.init(Glib::Value<Glib::ustring>::value_type());
+    text.set(column == COLUMN_DIR ? completion.dir : completion.name);
+    value.init(Glib::Value<Glib::ustring>::value_type());
+    value = text;
+}
+
+bool ResultModel::iter_next_vfunc(const iterator& iter,
+                                  iterator& iter_next) const
+{
+    int row = this->get_row(iter);
+    iter_next = iterator();
+    if (row < 0 || row + 1 >= this->m_size)
+        return false;
+    this->set_row(iter_next, row + 1);
+    return true;
+}
+
+bool ResultModel::iter_children_vfunc(const iterator&, iterator& iter) const
+{
+    iter = iterator();
+    return false;
+}
+
+bool ResultModel::iter_has_child_vfunc(const iterator&) const
+{
+    return false;
+}
+
+int ResultModel::iter_n_children_vfunc(const iterator&) const
+{
+    return 0;
+}
+
+int ResultModel::iter_n_root_children_vfunc() const
+{
+    return this->m_size;
+}
+
+bool ResultModel::iter_nth_child_vfunc(const iterator&, int,
+                                       iterator& iter) const
+{
+    iter = iterator();
+    return false;
+}
+
+bool ResultModel::iter_nth_root_child_vfunc(int n, iterator& iter) const
+{
+    iter = iterator();
+    if (n < 0 || n >= this->m_size)
+        return false;
+    this->set_row(iter, n);
+    return true;
+}
+
+bool ResultModel::iter_parent_vfunc(const iterator&, iterator& iter) const
+{
+    iter = iterator();
+    return false;
+}
+
+Gtk::TreeModel::Path ResultModel::get_path_vfunc(const iterator& iter) const
+{
+    Path path;
+    int row = this->get_row(iter);
+    if (row >= 0)
+        path.push_back(row);
+    return path;
+}
+
+bool ResultModel::get_iter_vfunc(const Path& path, iterator& iter) const
+{
+    iter = iterator();
+    if (path.size() != 1 || path[0] < 0 || path[0] >= this->m_size)
+        return false;
+    this->set_row(iter, path[0]);
+    return true;
+}
+
+bool ResultModel::iter_is_valid(const iterator& iter) const
+{
+    return this->get_row(iter) >= 0;
+}
@@ -0,0 +1,70 @@
+/*
+    result-model
+    ~~~~~~~~~~~~
+
+    A flat Gtk::TreeModel that serves the completer's result array as is,
+    instead of copying every result into a Gtk::ListStore.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_RESULT_MODEL_H
+#define TUDOR_DO_RESULT_MODEL_H
+#include <vector>
+#include <glibmm.h>
+#include <gtkmm.h>
+#include "results.h"
+
+class ResultModel : public Glib::Object, public Gtk::TreeModel
+{
+    public:
+        enum
+        {
+            COLUMN_DIR,
+            COLUMN_FILE,
+            COLUMN_COUNT
+        };
+
+        static Glib::RefPtr<ResultModel> create();
+        virtual ~ResultModel();
+
+        // Takes the rows out of |results|, leaving it empty. Only rows that
+        // are not in both the old and the new results are deleted or
+        // inserted.
+        void set_results(std::vector<Completion>& results);
+        inline const std::vector<Completion>& get_results() const
+        {
+            return this->m_rows;
+        }
+    protected:
+        std::vector<Completion>     m_rows;
+        int                         m_size;
+        int                         m_stamp;
+
+        ResultModel();
+        void set_row(iterator& iter, int row) const;
+        int get_row(const iterator& iter) const;
+
+        virtual Gtk::TreeModelFlags get_flags_vfunc() const;
+        virtual int get_n_columns_vfunc() const;
+        virtual GType get_column_type_vfunc(int index) const;
+        virtual void get_value_vfunc(const iterator& iter, int column,
+                                     Glib::ValueBase& value) const;
+        virtual bool iter_next_vfunc(const iterator& iter,
+                                     iterator& iter_next) const;
+        virtual bool iter_children_vfunc(const iterator& parent,
+                                         iterator& iter) const;
+        virtual bool iter_has_child_vfunc(const iterator& iter) const;
+        virtual int iter_n_children_vfunc(const iterator& iter) const;
+        virtual int iter_n_root_children_vfunc() const;
+        virtual bool iter_nth_child_vfunc(const iterator& parent, int n,
+                                          iterator& iter) const;
+        virtual bool iter_nth_root_child_vfunc(int n, iterator& iter) const;
+        virtual bool iter_parent_vfunc(const iterator& child,
+                                       iterator& iter) const;
+        virtual Path get_path_vfunc(const iterator& iter) const;
+        virtual bool get_iter_vfunc(const Path& path, iterator& iter) const;
+        virtual bool iter_is_valid(const iterator& iter) const;
+};
+
+#endif /* TUDOR_DO_RESULT_MODEL_H */
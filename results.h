@@ -0,0 +1,102 @@
+/*
+    results
+    ~~~~~~~
+
+    Completion results, and a bounded collector that keeps only the best K
+    candidates a query produces.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_RESULTS_H
+#define TUDOR_DO_RESULTS_H
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct Completion
+{
+    std::string     dir;
+    std::string     name;
+    int             score;
+
+    Completion() : score(0) { }
+    Completion(const std::string& d, const std::string& n, int s = 0)
+    : dir(d), name(n), score(s) { }
+};
+
+// Higher scores first, then shorter names, then alphabetical order.
+struct CompletionBetter
+{
+    bool operator()(const Completion& a, const Completion& b) const
+    {
+        if (a.score != b.score)
+            return a.score > b.score;
+        if (a.name.length() != b.name.length())
+            return a.name.length() < b.name.length();
+        return a.name < b.name;
+    }
+};
+
+// Keeps the best |limit| values pushed into it. The heap is ordered so its
+// front is the worst value kept, which is the one a better candidate evicts.
+template <typename T, typename Better = std::less<T> >
+class TopK
+{
+    public:
+        TopK(size_t limit, Better better = Better())
+        : m_limit(limit), m_better(better)
+        {
+            this->m_heap.reserve(limit);
+        }
+
+        inline size_t size() const { return this->m_heap.size(); }
+        inline size_t limit() const { return this->m_limit; }
+        inline bool full() const
+        {
+            return this->m_heap.size() >= this->m_limit;
+        }
+
+        // Whether pushing the value would keep it; lets callers skip
+        // building a candidate that is going to be thrown away.
+        inline bool accepts(const T& value) const
+        {
+            return !this->full()
+                || this->m_better(value, this->m_heap.front());
+        }
+
+        void push(const T& value)
+        {
+            if (this->m_limit == 0) return;
+            if (!this->full())
+            {
+                this->m_heap.push_back(value);
+                std::push_heap(this->m_heap.begin(), this->m_heap.end(),
+                               this->m_better);
+            }
+            else if (this->m_better(value, this->m_heap.front()))
+            {
+                std::pop_heap(this->m_heap.begin(), this->m_heap.end(),
+                              this->m_better);
+                this->m_heap.back() = value;
+                std::push_heap(this->m_heap.begin(), this->m_heap.end(),
+                               this->m_better);
+            }
+        }
+
+        // Moves the kept values out, best first, and empties the collector.
+        void take(std::vector<T>& out)
+        {
+            std::sort_heap(this->m_heap.begin(), this->m_heap.end(),
+                           this->m_better);
+            out.insert(out.end(), this->m_heap.begin(), this->m_heap.end());
+            this->m_heap.clear();
+        }
+    protected:
+        size_t          m_limit;
+        Better          m_better;
+        std::vector<T>  m_heap;
+};
+
+#endif /* TUDOR_DO_RESULTS_H */
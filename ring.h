@@ -0,0 +1,72 @@
+/*
+    ring
+    ~~~~
+
+    A bounded, lock-free ring buffer for handing values from exactly one
+    producer thread to exactly one consumer thread. Each side only writes
+    its own index, so neither ever waits for the other.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_RING_H
+#define TUDOR_DO_RING_H
+#include <algorithm>
+#include <vector>
+#include <glibmm.h>
+
+template <typename T>
+class SpscRing
+{
+    public:
+        // |capacity| is rounded up to a power of two.
+        SpscRing(size_t capacity) : m_head(0), m_tail(0)
+        {
+            size_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            this->m_slots.resize(size);
+            this->m_mask = size - 1;
+        }
+
+        // Producer only. Returns false, leaving the ring as it was, when
+        // it is full.
+        bool push(const T& value)
+        {
+            guint tail = (guint) g_atomic_int_get(&this->m_tail);
+            guint head = (guint) g_atomic_int_get(&this->m_head);
+            if (tail - head > this->m_mask)
+                return false;
+            this->m_slots[tail & this->m_mask] = value;
+            // Publishes the slot written above.
+            g_atomic_int_set(&this->m_tail, (gint) (tail + 1));
+            return true;
+        }
+
+        // Consumer only. Moves up to |limit| values to the end of
+        // |values| and returns how many there were.
+        size_t pop(std::vector<T>& values, size_t limit)
+        {
+            guint head = (guint) g_atomic_int_get(&this->m_head);
+            guint tail = (guint) g_atomic_int_get(&this->m_tail);
+            size_t count = std::min((size_t) (tail - head), limit);
+            for (size_t i = 0; i < count; i++)
+            {
+                values.push_back(T());
+                std::swap(values.back(),
+                          this->m_slots[(head + i) & this->m_mask]);
+            }
+            // Hands the slots read above back to the producer.
+            g_atomic_int_set(&this->m_head, (gint) (head + count));
+            return count;
+        }
+    private:
+        std::vector<T>  m_slots;
+        size_t          m_mask;
+        // Kept on separate cache lines, as each is written by one side.
+        gint            m_head;     // next slot to read
+        char            m_padding[64];
+        gint            m_tail;     // next slot to write
+};
+
+#endif /* TUDOR_DO_RING_H */
@@ -0,0 +1,191 @@
+/*
+    scan
+    ~~~~
+
+    Lists directories with raw getdents64 calls, packing the names of each
+    directory into a single buffer so a scan does not allocate per entry.
+    A batch of directories can be listed concurrently.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <glibmm.h>
+#include "scan.h"
+
+namespace
+{
+    // Large enough to read a typical bin directory in a handful of calls.
+    const size_t SCAN_BUFFER_SIZE = 32 * 1024;
+
+    // The record layout getdents64 fills in; glibc does not export it.
+    struct linux_dirent64
+    {
+        uint64_t        d_ino;
+        int64_t         d_off;
+        unsigned short  d_reclen;
+        unsigned char   d_type;
+        char            d_name[1];
+    };
+}
+
+bool DirectoryStamp::operator==(const DirectoryStamp& other) const
+{
+    return this->dev == other.dev && this->ino == other.ino
+        && this->mtime_sec == other.mtime_sec
+        && this->mtime_nsec == other.mtime_nsec;
+}
+
+void DirectoryStamp::assign(const struct stat& st)
+{
+    this->dev        = st.st_dev;
+    this->ino        = st.st_ino;
+    this->mtime_sec  = st.st_mtim.tv_sec;
+    this->mtime_nsec = st.st_mtim.tv_nsec;
+}
+
+bool DirectoryStamp::read(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1 || !S_ISDIR(st.st_mode))
+    {
+        *this = DirectoryStamp();
+        return false;
+    }
+    this->assign(st);
+    return true;
+}
+
+DirectoryScan::DirectoryScan(const std::vector<std::string>& paths) :
+m_listings(paths.size()), m_next(0)
+{
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        this->m_listings[i].path  = paths[i];
+        this->m_listings[i].dev   = 0;
+        this->m_listings[i].count = 0;
+        this->m_listings[i].ok    = false;
+    }
+}
+
+DirectoryScan::~DirectoryScan()
+{
+}
+
+void DirectoryScan::run(size_t threads)
+{
+    // Slow directories dominate startup, so the threads mostly wait on
+    // I/O; the calling thread takes a share of the work as well.
+    if (threads > this->m_listings.size())
+        threads = this->m_listings.size();
+    std::vector<Glib::Thread*> pool;
+    for (size_t i = 1; i < threads; i++)
+    {
+        try
+        {
+            pool.push_back(Glib::Thread::create(sigc::mem_fun(*this,
+                &DirectoryScan::work), true));
+        } catch (Glib::ThreadError) {
+            break;
+        }
+    }
+    this->work();
+    for (size_t i = 0; i < pool.size(); i++)
+        pool[i]->join();
+}
+
+void DirectoryScan::work()
+{
+    DirectoryReader reader;
+    int next;
+    while ((next = g_atomic_int_add(&this->m_next, 1))
+           < (int) this->m_listings.size())
+    {
+        Listing& listing = this->m_listings[next];
+        if (!reader.open(listing))
+            continue;
+        while (reader.read(listing))
+            ;
+        listing.ok = !reader.failed();
+        reader.close();
+    }
+}
+
+DirectoryReader::DirectoryReader() :
+m_fd(-1), m_failed(false), m_buffer(SCAN_BUFFER_SIZE)
+{
+}
+
+DirectoryReader::~DirectoryReader()
+{
+    this->close();
+}
+
+bool DirectoryReader::open(DirectoryScan::Listing& listing)
+{
+    this->close();
+    this->m_failed = true;
+    this->m_fd = ::open(listing.path.c_str(),
+                        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (this->m_fd == -1) return false;
+
+    struct stat st;
+    if (fstat(this->m_fd, &st) == -1)
+    {
+        this->close();
+        return false;
+    }
+    // Taken before the first name is read, so a change made while the
+    // directory is being read leaves the listing looking stale.
+    listing.dev = st.st_dev;
+    listing.stamp.assign(st);
+    this->m_failed = false;
+    return true;
+}
+
+bool DirectoryReader::read(DirectoryScan::Listing& listing)
+{
+    if (this->m_fd == -1)
+        return false;
+    long bytes;
+    while ((bytes = syscall(SYS_getdents64, this->m_fd, &this->m_buffer[0],
+                            this->m_buffer.size())) == -1
+           && errno == EINTR)
+        ;
+    if (bytes <= 0)
+    {
+        this->m_failed = bytes < 0;
+        this->close();
+        return false;
+    }
+    for (long pos = 0; pos < bytes;)
+    {
+        const linux_dirent64* entry =
+            (const linux_dirent64*) &this->m_buffer[pos];
+        pos += entry->d_reclen;
+
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' ||
+            (name[1] == '.' && name[2] == '\0')))
+            continue;
+        listing.names.insert(listing.names.end(), name,
+                             name + strlen(name) + 1);
+        listing.inodes.push_back(entry->d_ino);
+        listing.types.push_back(entry->d_type);
+        listing.count++;
+    }
+    return true;
+}
+
+void DirectoryReader::close()
+{
+    if (this->m_fd != -1)
+        ::close(this->m_fd);
+    this->m_fd = -1;
+}
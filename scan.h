@@ -0,0 +1,96 @@
+/*
+    scan
+    ~~~~
+
+    Lists directories with raw getdents64 calls, packing the names of each
+    directory into a single buffer so a scan does not allocate per entry.
+    A batch of directories can be listed concurrently.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_SCAN_H
+#define TUDOR_DO_SCAN_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct stat;
+
+// Tells one version of a directory from the next: a listing stays current
+// as long as the directory's stamp does not change.
+struct DirectoryStamp
+{
+    uint64_t    dev;
+    uint64_t    ino;
+    int64_t     mtime_sec;
+    int64_t     mtime_nsec;
+
+    DirectoryStamp() : dev(0), ino(0), mtime_sec(0), mtime_nsec(0) { }
+    // No directory has inode 0, so a default stamp matches nothing.
+    inline bool known() const { return this->ino != 0; }
+    bool operator==(const DirectoryStamp& other) const;
+    inline bool operator!=(const DirectoryStamp& other) const
+    {
+        return !(*this == other);
+    }
+
+    void assign(const struct stat& st);
+    // Stamps |path| as it is now.
+    bool read(const std::string& path);
+};
+
+class DirectoryScan
+{
+    public:
+        struct Listing
+        {
+            std::string                 path;
+            uint64_t                    dev;
+            DirectoryStamp              stamp;  // taken before reading
+            std::vector<char>           names;  // NUL-terminated, back to back
+            std::vector<uint64_t>       inodes; // per name, from d_ino
+            std::vector<unsigned char>  types;  // per name, from d_type
+            size_t                      count;
+            bool                        ok;
+        };
+
+        DirectoryScan(const std::vector<std::string>& paths);
+        virtual ~DirectoryScan();
+
+        // Blocks until every directory has been read, using at most
+        // |threads| threads including the caller's.
+        void run(size_t threads);
+        inline const std::vector<Listing>& listings() const
+        {
+            return this->m_listings;
+        }
+    protected:
+        std::vector<Listing>    m_listings;
+        volatile int            m_next;
+
+        void work();
+};
+
+// Reads a single directory one getdents64 buffer at a time, so a caller
+// can act on the first names before a huge directory has been read.
+class DirectoryReader
+{
+    public:
+        DirectoryReader();
+        virtual ~DirectoryReader();
+
+        // Opens |listing|.path and fills in its device and stamp.
+        bool open(DirectoryScan::Listing& listing);
+        // Appends the next batch of names to |listing|. Returns false once
+        // the directory is exhausted; failed() tells an error from the end.
+        bool read(DirectoryScan::Listing& listing);
+        inline bool failed() const { return this->m_failed; }
+        void close();
+    protected:
+        int                 m_fd;
+        bool                m_failed;
+        std::vector<char>   m_buffer;
+};
+
+#endif /* TUDOR_DO_SCAN_H */
@@ -0,0 +1,120 @@
+/*
+    launch-bench
+    ~~~~~~~~~~~~
+
+    Measures how long it takes to start a command from a process with a
+    large resident heap, like the dialog once GTK and the index are
+    loaded: through the Launcher, spawning directly and through the
+    zygote, and through Glib::spawn_command_line_async(), which forks the
+    whole process. Each launch is timed until the child has exec'd.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <glibmm.h>
+#include "../launcher.h"
+#include "../zygote.h"
+
+namespace
+{
+    const size_t HEAP_SIZE = 256 * 1024 * 1024;
+    const int LAUNCHES = 200;
+    const char* COMMAND = "/bin/true";
+
+    int64_t now_us()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    // Children spawned from this process are collected here, since no
+    // main loop runs to do it.
+    void reap()
+    {
+        while (waitpid(-1, 0, WNOHANG) > 0)
+            ;
+    }
+
+    void report(const char* label, int count, int64_t total, int64_t worst)
+    {
+        std::printf("%-12s %4d launches  mean %7.3f ms  worst %7.3f ms\n",
+                    label, count, count ? total / 1e3 / count : 0.0,
+                    worst / 1e3);
+    }
+
+    bool bench_launcher(const char* label, Zygote* zygote)
+    {
+        Launcher launcher;
+        launcher.set_zygote(zygote);
+        std::vector<std::string> argv(1, COMMAND);
+        std::string error;
+        for (int i = 0; i < LAUNCHES; i++)
+        {
+            if (!launcher.launch(COMMAND, argv, error))
+            {
+                std::fprintf(stderr, "launch-bench: %s\n", error.c_str());
+                return false;
+            }
+            reap();
+        }
+        const Launcher::Timing& timing = launcher.timing();
+        report(label, timing.count, timing.total, timing.worst);
+        return true;
+    }
+
+    bool bench_glib()
+    {
+        int64_t total = 0, worst = 0;
+        for (int i = 0; i < LAUNCHES; i++)
+        {
+            int64_t start = now_us();
+            try
+            {
+                Glib::spawn_command_line_async(COMMAND);
+            } catch (Glib::SpawnError& e) {
+                std::fprintf(stderr, "launch-bench: %s\n", e.what().c_str());
+                return false;
+            }
+            int64_t elapsed = now_us() - start;
+            total += elapsed;
+            worst = std::max(worst, elapsed);
+            reap();
+        }
+        report("glib", LAUNCHES, total, worst);
+        return true;
+    }
+}
+
+int main()
+{
+    // The zygote is forked while this process is still small, as the
+    // dialog does.
+    Zygote zygote;
+    if (!zygote.start())
+    {
+        std::fprintf(stderr, "launch-bench: cannot start the zygote\n");
+        return 1;
+    }
+
+    // Every page is written, so it is resident and has to be mapped into
+    // a forked child.
+    std::vector<char> heap(HEAP_SIZE);
+    for (size_t i = 0; i < heap.size(); i += 4096)
+        heap[i] = (char) i;
+    std::printf("%lu MB resident heap, %s\n",
+                (unsigned long) (HEAP_SIZE >> 20), COMMAND);
+
+    bool ok = bench_launcher("posix_spawn", 0)
+              && bench_launcher("zygote", &zygote)
+              && bench_glib();
+    zygote.stop();
+    return ok ? 0 : 1;
+}
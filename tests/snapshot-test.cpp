@@ -0,0 +1,164 @@
+/*
+    snapshot-test
+    ~~~~~~~~~~~~~
+
+    Stresses how the monitor publishes snapshots of its index: a writer
+    keeps changing the index and the boosts while readers query it, and
+    every query has to see the index as it was at one publish, never as
+    it was halfway through a change. Meant to be run under ThreadSanitizer
+    as well (make clean check SANITIZE=thread).
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glibmm.h>
+#include "../monitor.h"
+
+namespace
+{
+    // At version v of the index, name i is "i.q" for q = v / NAMES, or
+    // "i.q+1" for i < v % NAMES: each version renames a single name, so
+    // most snapshots are built by replaying the journal.
+    const int NAMES = 64;
+    const int VERSIONS = 20000;
+    const int READERS = 4;
+
+    std::string name(int index, int version)
+    {
+        std::ostringstream out;
+        out << index << '.' << (version + NAMES - 1 - index) / NAMES;
+        return out.str();
+    }
+
+    void fail(const std::string& msg)
+    {
+        std::fprintf(stderr, "snapshot-test: %s\n", msg.c_str());
+        std::exit(1);
+    }
+}
+
+class SnapshotTest : public PathMonitor
+{
+    public:
+        SnapshotTest() : m_version(0), m_done(0)
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            this->m_dir = this->m_trie.add_directory("/nonexistent");
+            for (int i = 0; i < NAMES; i++)
+                this->m_trie.insert(name(i, 0), this->m_dir);
+            this->m_generation++;
+            this->publish();
+        }
+
+        void write()
+        {
+            for (int version = 1; version <= VERSIONS; version++)
+            {
+                int index = (version - 1) % NAMES;
+                {
+                    Glib::Mutex::Lock lock(this->m_mutex);
+                    this->m_trie.remove(name(index, version - 1),
+                                        this->m_dir);
+                    this->m_trie.insert(name(index, version), this->m_dir);
+                    this->m_version = version;
+                    this->m_generation++;
+                    this->publish();
+                }
+                // Boost-only publishes share the trie of the one before.
+                if (version % 7 == 0)
+                {
+                    std::map<std::string, int> boosts;
+                    boosts[name(index, version)] = version;
+                    this->set_boosts(boosts);
+                }
+            }
+            g_atomic_int_set(&this->m_done, 1);
+        }
+
+        void read()
+        {
+            PathMonitor::Candidates previous, matched;
+            std::vector<Completion> results;
+            std::vector<int> versions(NAMES);
+            unsigned int generation = 0;
+            while (!g_atomic_int_get(&this->m_done))
+            {
+                // Narrowing reuses leaf ids from the last query when the
+                // generation is unchanged.
+                results.clear();
+                this->find_prefix("", NAMES, &previous, matched, results);
+                if (matched.generation < generation)
+                    fail("a query saw an older generation");
+                generation = matched.generation;
+                previous = matched;
+                if (results.size() != (size_t) NAMES)
+                    fail("a query saw names missing or duplicated");
+
+                // Consistent with a single version: the renamed names
+                // come first and are exactly one ahead of the rest.
+                std::fill(versions.begin(), versions.end(), -1);
+                for (size_t i = 0; i < results.size(); i++)
+                {
+                    int index, version;
+                    if (std::sscanf(results[i].name.c_str(), "%d.%d",
+                                    &index, &version) != 2
+                        || index < 0 || index >= NAMES
+                        || versions[index] != -1)
+                        fail("a query saw a bad or repeated name: "
+                             + results[i].name);
+                    versions[index] = version;
+                }
+                for (int i = 1; i < NAMES; i++)
+                    if (versions[i] > versions[i - 1]
+                        || versions[0] - versions[i] > 1)
+                        fail("a query saw a change halfway");
+
+                std::string path;
+                if (!this->resolve(results[0].name, path)
+                    && this->generation() == generation)
+                    fail("a name vanished within a generation");
+            }
+        }
+
+        // Once readers are gone, the next publish frees every snapshot
+        // but the current one, and every trie but the current one and
+        // the one kept for recycling.
+        void check_reclaimed()
+        {
+            Glib::Mutex::Lock lock(this->m_mutex);
+            this->m_trie.remove(name(0, this->m_version), this->m_dir);
+            this->m_generation++;
+            this->publish();
+            if (!this->m_retired.empty())
+                fail("retired snapshots were not freed");
+            if (this->m_trie_users.size() > 2)
+                fail("unused tries were not freed");
+        }
+    private:
+        uint16_t                     m_dir;
+        int                          m_version;
+        gint                         m_done;
+};
+
+int main()
+{
+    if (!Glib::thread_supported()) Glib::thread_init();
+    SnapshotTest test;
+    std::vector<Glib::Thread*> readers;
+    for (int i = 0; i < READERS; i++)
+        readers.push_back(Glib::Thread::create(
+            sigc::mem_fun(test, &SnapshotTest::read), true));
+    test.write();
+    for (size_t i = 0; i < readers.size(); i++)
+        readers[i]->join();
+    test.check_reclaimed();
+    std::printf("snapshot-test: %d versions, %d readers: ok\n",
+                VERSIONS, READERS);
+    return 0;
+}
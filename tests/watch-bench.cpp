@@ -0,0 +1,200 @@
+/*
+    watch-bench
+    ~~~~~~~~~~~
+
+    Measures how watch lookups scale with the number of watches: first
+    the lookups alone, by descriptor and by path, against the ordered
+    maps inotify-cxx used before; then the events read from that many
+    real watches, as far as fs.inotify.max_user_watches allows.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "../inotify-cxx.h"
+
+namespace
+{
+    const int SIZES[] = { 10, 1000, 100000 };
+    const int LOOKUPS = 1000000;
+    const int BATCH = 8192;
+    const int ROUNDS = 20;
+
+    // Where lookups and event counts go, so they are not optimized away.
+    volatile uintptr_t sink;
+
+    int64_t now_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    // Lookups hit watches in no particular order, as events do.
+    uint32_t next_random(uint32_t& state)
+    {
+        state = state * 1103515245 + 12345;
+        return state >> 8;
+    }
+
+    std::string dir_path(const std::string& root, int i)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/d-%06d", i);
+        return root + name;
+    }
+
+    void bench_lookups(const std::string& root, int size)
+    {
+        std::vector<InotifyWatch*> watches;
+        std::vector<std::string> paths;
+        IN_WATCH_MAP by_wd;
+        IN_WP_MAP by_path;
+        std::map<int32_t, InotifyWatch*> by_wd_before;
+        std::map<std::string, InotifyWatch*> by_path_before;
+        for (int i = 0; i < size; i++)
+        {
+            paths.push_back(dir_path(root, i));
+            watches.push_back(new InotifyWatch(paths.back(), IN_ATTRIB));
+            // Descriptors start at 1.
+            by_wd.Insert(i + 1, watches.back());
+            by_path[paths.back()] = watches.back();
+            by_wd_before[i + 1] = watches.back();
+            by_path_before[paths.back()] = watches.back();
+        }
+
+        int64_t elapsed[4] = { 0, 0, 0, 0 };
+        uintptr_t found = 0;
+        uint32_t state = 1;
+        int64_t start = now_ns();
+        for (int i = 0; i < LOOKUPS; i++)
+            found += (uintptr_t) by_wd.Find(next_random(state) % size + 1);
+        elapsed[0] = now_ns() - start;
+        state = 1;
+        start = now_ns();
+        for (int i = 0; i < LOOKUPS; i++)
+            found += (uintptr_t) by_wd_before.find(
+                next_random(state) % size + 1)->second;
+        elapsed[1] = now_ns() - start;
+        state = 1;
+        start = now_ns();
+        for (int i = 0; i < LOOKUPS; i++)
+            found += (uintptr_t) by_path.find(
+                paths[next_random(state) % size])->second;
+        elapsed[2] = now_ns() - start;
+        state = 1;
+        start = now_ns();
+        for (int i = 0; i < LOOKUPS; i++)
+            found += (uintptr_t) by_path_before.find(
+                paths[next_random(state) % size])->second;
+        elapsed[3] = now_ns() - start;
+        sink += found;
+
+        std::printf("%6d watches  by wd %6.1f ns (map %6.1f ns)  "
+                    "by path %6.1f ns (map %6.1f ns)\n", size,
+                    (double) elapsed[0] / LOOKUPS,
+                    (double) elapsed[1] / LOOKUPS,
+                    (double) elapsed[2] / LOOKUPS,
+                    (double) elapsed[3] / LOOKUPS);
+        for (size_t i = 0; i < watches.size(); i++)
+            delete watches[i];
+    }
+
+    void bench_events(const std::string& root, int size, int batch)
+    {
+        // The watches have to outlive the instance, which forgets them on
+        // closing.
+        std::vector<InotifyWatch*> watches;
+        for (int i = 0; i < size; i++)
+            watches.push_back(new InotifyWatch(dir_path(root, i), IN_ATTRIB));
+        {
+            Inotify notify;
+            notify.SetNonBlock(true);
+            for (int i = 0; i < size; i++)
+                notify.Add(watches[i]);
+
+            size_t events = 0;
+            int64_t elapsed = 0;
+            uint32_t state = 1;
+            std::vector<InotifyEventView> views;
+            for (int round = 0; round < ROUNDS; round++)
+            {
+                for (int i = 0; i < batch; i++)
+                    utimes(watches[next_random(state) % size]->GetPath()
+                           .c_str(), NULL);
+                int64_t start = now_ns();
+                for (notify.ReadEvents(views); !views.empty();
+                     notify.ReadEvents(views))
+                {
+                    for (size_t i = 0; i < views.size(); i++)
+                        sink += (uintptr_t) views[i].GetWatch();
+                    events += views.size();
+                }
+                elapsed += now_ns() - start;
+            }
+            std::printf("%6d watches  %8lu events  %10.0f events/s%s\n",
+                        size, (unsigned long) events,
+                        events / (elapsed / 1e9),
+                        notify.CheckOverflow() ? "  (overflowed)" : "");
+        }
+        for (size_t i = 0; i < watches.size(); i++)
+            delete watches[i];
+    }
+}
+
+int main()
+{
+    char root[] = "/tmp/watch-bench.XXXXXX";
+    if (!mkdtemp(root))
+    {
+        std::perror("watch-bench: mkdtemp");
+        return 1;
+    }
+    const int count = sizeof(SIZES) / sizeof(SIZES[0]);
+    int largest = SIZES[count - 1];
+
+    std::printf("lookups\n");
+    for (int i = 0; i < count; i++)
+        bench_lookups(root, SIZES[i]);
+
+    int status = 0;
+    int made = 0;
+    try
+    {
+        // Leave some watches to whatever else runs as this user.
+        int limit = (int) Inotify::GetMaxWatches() - 1000;
+        int batch = std::min<int>(BATCH, Inotify::GetMaxEvents() / 2);
+        for (; made < std::min(largest, limit); made++)
+            if (mkdir(dir_path(root, made).c_str(), 0700) == -1)
+                break;
+        std::printf("events\n");
+        for (int i = 0; i < count; i++)
+        {
+            if (SIZES[i] > made)
+            {
+                std::printf("%6d watches  not allowed, capped:\n", SIZES[i]);
+                bench_events(root, made, batch);
+                break;
+            }
+            bench_events(root, SIZES[i], batch);
+        }
+    } catch (InotifyException& e) {
+        std::fprintf(stderr, "watch-bench: %s\n", e.GetMessage().c_str());
+        status = 1;
+    }
+
+    for (int i = 0; i < made; i++)
+        rmdir(dir_path(root, i).c_str());
+    rmdir(root);
+    return status;
+}
@@ -0,0 +1,357 @@
+/*
+    trie
+    ~~~~
+
+    A compressed radix trie over executable names. Every name remembers
+    which $PATH directories provide it, so directory events can insert or
+    remove a single name in time proportional to its length.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <algorithm>
+#include "fuzzy.h"
+#include "trie.h"
+
+PathTrie::PathTrie() : m_root(new Node()), m_count(0), m_journal(0)
+{
+}
+
+PathTrie::PathTrie(const PathTrie& other) :
+m_root(PathTrie::clone(other.m_root)), m_leaves(other.m_leaves),
+m_bags(other.m_bags), m_free(other.m_free), m_dirs(other.m_dirs),
+m_dir_ids(other.m_dir_ids), m_count(other.m_count), m_journal(0)
+{
+}
+
+PathTrie& PathTrie::operator=(const PathTrie& other)
+{
+    if (this != &other)
+    {
+        Node* root = PathTrie::clone(other.m_root);
+        this->destroy(this->m_root);
+        this->m_root    = root;
+        this->m_leaves  = other.m_leaves;
+        this->m_bags    = other.m_bags;
+        this->m_free    = other.m_free;
+        this->m_dirs    = other.m_dirs;
+        this->m_dir_ids = other.m_dir_ids;
+        this->m_count   = other.m_count;
+    }
+    return *this;
+}
+
+PathTrie::~PathTrie()
+{
+    this->destroy(this->m_root);
+}
+
+void PathTrie::clear()
+{
+    this->destroy(this->m_root);
+    this->m_root = new Node();
+    this->m_leaves.clear();
+    this->m_bags.clear();
+    this->m_free.clear();
+    this->m_count = 0;
+    this->record(Change::CLEAR, std::string(), 0);
+}
+
+void PathTrie::replay(const t_journal& journal)
+{
+    for (size_t i = 0; i < journal.size(); i++)
+    {
+        const Change& change = journal[i];
+        switch (change.kind)
+        {
+            case Change::INSERT:
+                this->insert(change.name, change.dir);
+                break;
+            case Change::REMOVE:
+                this->remove(change.name, change.dir);
+                break;
+            case Change::ADD_DIRECTORY:
+                this->add_directory(change.name);
+                break;
+            case Change::CLEAR:
+                this->clear();
+                break;
+        }
+    }
+}
+
+void PathTrie::record(Change::Kind kind, const std::string& name,
+                      uint16_t dir)
+{
+    if (!this->m_journal)
+        return;
+    Change change;
+    change.kind = kind;
+    change.name = name;
+    change.dir = dir;
+    this->m_journal->push_back(change);
+}
+
+uint16_t PathTrie::add_directory(const std::string& path)
+{
+    std::map<std::string, uint16_t>::const_iterator it;
+    if ((it = this->m_dir_ids.find(path)) != this->m_dir_ids.end())
+        return it->second;
+    uint16_t id = this->m_dirs.size();
+    this->m_dirs.push_back(path);
+    this->m_dir_ids[path] = id;
+    this->record(Change::ADD_DIRECTORY, path, id);
+    return id;
+}
+
+int PathTrie::find_directory(const std::string& path) const
+{
+    std::map<std::string, uint16_t>::const_iterator it;
+    it = this->m_dir_ids.find(path);
+    return (it == this->m_dir_ids.end()) ? -1 : it->second;
+}
+
+void PathTrie::remove_directory(uint16_t dir)
+{
+    for (size_t i = 0; i < this->m_leaves.size(); i++)
+    {
+        const std::vector<uint16_t>& dirs = this->m_leaves[i].dirs;
+        if (std::binary_search(dirs.begin(), dirs.end(), dir))
+        {
+            std::string name = this->m_leaves[i].name;
+            this->remove(name, dir);
+        }
+    }
+}
+
+bool PathTrie::insert(const std::string& name, uint16_t dir)
+{
+    if (name.empty()) return false;
+
+    Node* node = this->m_root;
+    size_t i = 0;
+    while (i < name.length())
+    {
+        size_t pos;
+        Node* next = PathTrie::child(node, name[i], &pos);
+        if (!next)
+        {
+            next = new Node();
+            next->label = name.substr(i);
+            node->children.insert(node->children.begin() + pos, next);
+            node = next;
+            break;
+        }
+
+        const std::string& label = next->label;
+        size_t len = 0;
+        while (len < label.length() && i + len < name.length()
+               && label[len] == name[i + len])
+            len++;
+        i += len;
+        if (len == label.length())
+        {
+            node = next;
+            continue;
+        }
+
+        // The name diverges inside this edge: split it at the divergence.
+        Node* mid = new Node();
+        mid->label = label.substr(0, len);
+        next->label.erase(0, len);
+        mid->children.push_back(next);
+        node->children[pos] = mid;
+        node = mid;
+        if (i < name.length())
+        {
+            Node* tail = new Node();
+            tail->label = name.substr(i);
+            if ((unsigned char) tail->label[0]
+                < (unsigned char) next->label[0])
+                mid->children.insert(mid->children.begin(), tail);
+            else
+                mid->children.push_back(tail);
+            node = tail;
+        }
+        break;
+    }
+
+    if (node->leaf < 0)
+        node->leaf = this->allocate_leaf(name);
+    std::vector<uint16_t>& dirs = this->m_leaves[node->leaf].dirs;
+    std::vector<uint16_t>::iterator it;
+    it = std::lower_bound(dirs.begin(), dirs.end(), dir);
+    if (it != dirs.end() && *it == dir)
+        return false;
+    dirs.insert(it, dir);
+    if (dirs.size() == 1)
+        this->m_count++;
+    this->record(Change::INSERT, name, dir);
+    return true;
+}
+
+bool PathTrie::remove(const std::string& name, uint16_t dir)
+{
+    std::vector<Node*> path(1, this->m_root);
+    Node* node = this->m_root;
+    size_t i = 0;
+    while (i < name.length())
+    {
+        Node* next = PathTrie::child(node, name[i]);
+        if (!next || name.compare(i, next->label.length(), next->label) != 0)
+            return false;
+        i += next->label.length();
+        path.push_back(next);
+        node = next;
+    }
+    if (node->leaf < 0) return false;
+
+    std::vector<uint16_t>& dirs = this->m_leaves[node->leaf].dirs;
+    std::vector<uint16_t>::iterator it;
+    it = std::lower_bound(dirs.begin(), dirs.end(), dir);
+    if (it == dirs.end() || *it != dir)
+        return false;
+    dirs.erase(it);
+    this->record(Change::REMOVE, name, dir);
+    if (!dirs.empty())
+        return true;
+
+    this->release_leaf(node->leaf);
+    node->leaf = -1;
+    this->m_count--;
+
+    // Prune emptied nodes and fold single-child chains back into one edge.
+    for (size_t k = path.size() - 1; k > 0; k--)
+    {
+        Node* cur = path[k];
+        if (cur->leaf >= 0) break;
+        if (cur->children.empty())
+        {
+            std::vector<Node*>& siblings = path[k - 1]->children;
+            siblings.erase(std::find(siblings.begin(), siblings.end(), cur));
+            delete cur;
+            continue;
+        }
+        if (cur->children.size() == 1)
+            PathTrie::merge(cur);
+        break;
+    }
+    return true;
+}
+
+const PathTrie::Leaf* PathTrie::find(const std::string& name) const
+{
+    const Node* node = this->m_root;
+    size_t i = 0;
+    while (i < name.length())
+    {
+        const Node* next = PathTrie::child(node, name[i]);
+        if (!next || name.compare(i, next->label.length(), next->label) != 0)
+            return 0;
+        i += next->label.length();
+        node = next;
+    }
+    return (node->leaf < 0) ? 0 : &this->m_leaves[node->leaf];
+}
+
+void PathTrie::prefix(const std::string& prefix,
+                      std::vector<uint32_t>& leaves) const
+{
+    const Node* node = this->m_root;
+    size_t i = 0;
+    while (i < prefix.length())
+    {
+        const Node* next = PathTrie::child(node, prefix[i]);
+        if (!next) return;
+        size_t len = std::min(next->label.length(), prefix.length() - i);
+        if (prefix.compare(i, len, next->label, 0, len) != 0)
+            return;
+        i += len;
+        node = next;
+    }
+    this->collect(node, leaves);
+}
+
+uint32_t PathTrie::allocate_leaf(const std::string& name)
+{
+    uint32_t id;
+    if (!this->m_free.empty())
+    {
+        id = this->m_free.back();
+        this->m_free.pop_back();
+    }
+    else
+    {
+        id = this->m_leaves.size();
+        this->m_leaves.push_back(Leaf());
+        this->m_bags.push_back(0);
+    }
+    this->m_leaves[id].name = name;
+    this->m_bags[id] = FuzzyMatcher::bag(name) | FuzzyMatcher::BAG_LIVE;
+    return id;
+}
+
+void PathTrie::release_leaf(uint32_t id)
+{
+    this->m_leaves[id].name.clear();
+    this->m_leaves[id].dirs.clear();
+    this->m_bags[id] = 0;
+    this->m_free.push_back(id);
+}
+
+void PathTrie::collect(const Node* node, std::vector<uint32_t>& leaves) const
+{
+    if (node->leaf >= 0)
+        leaves.push_back(node->leaf);
+    for (size_t i = 0; i < node->children.size(); i++)
+        this->collect(node->children[i], leaves);
+}
+
+void PathTrie::destroy(Node* node)
+{
+    for (size_t i = 0; i < node->children.size(); i++)
+        this->destroy(node->children[i]);
+    delete node;
+}
+
+PathTrie::Node* PathTrie::clone(const Node* node)
+{
+    Node* copy = new Node();
+    copy->label = node->label;
+    copy->leaf = node->leaf;
+    copy->children.reserve(node->children.size());
+    for (size_t i = 0; i < node->children.size(); i++)
+        copy->children.push_back(PathTrie::clone(node->children[i]));
+    return copy;
+}
+
+PathTrie::Node* PathTrie::child(const Node* node, char c, size_t* pos)
+{
+    // Children are kept ordered by the first byte of their label.
+    size_t lo = 0, hi = node->children.size();
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        unsigned char first = node->children[mid]->label[0];
+        if (first < (unsigned char) c)
+            lo = mid + 1;
+        else if (first > (unsigned char) c)
+            hi = mid;
+        else
+        {
+            if (pos) *pos = mid;
+            return node->children[mid];
+        }
+    }
+    if (pos) *pos = lo;
+    return 0;
+}
+
+void PathTrie::merge(Node* node)
+{
+    Node* only = node->children[0];
+    node->label += only->label;
+    node->leaf = only->leaf;
+    node->children.swap(only->children);
+    delete only;
+}
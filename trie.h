@@ -0,0 +1,123 @@
+/*
+    trie
+    ~~~~
+
+    A compressed radix trie over executable names. Every name remembers
+    which $PATH directories provide it, so directory events can insert or
+    remove a single name in time proportional to its length.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_TRIE_H
+#define TUDOR_DO_TRIE_H
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class PathTrie
+{
+    public:
+        struct Leaf
+        {
+            std::string             name;
+            std::vector<uint16_t>   dirs;
+        };
+
+        // A change made to a trie. Replaying the changes made since a copy
+        // was taken, in order, on that copy makes it equal to the
+        // original again, down to the leaf ids.
+        struct Change
+        {
+            enum Kind
+            {
+                INSERT,
+                REMOVE,
+                ADD_DIRECTORY,      // |name| is the path
+                CLEAR
+            };
+
+            Kind                    kind;
+            std::string             name;
+            uint16_t                dir;
+        };
+        typedef std::vector<Change> t_journal;
+
+        PathTrie();
+        // Copies are deep, so a copy can be read while the original
+        // keeps changing. The journal is not copied.
+        PathTrie(const PathTrie& other);
+        PathTrie& operator=(const PathTrie& other);
+        virtual ~PathTrie();
+        void clear();
+
+        // Appends every later change to |journal|; 0 stops recording.
+        inline void set_journal(t_journal* journal)
+        {
+            this->m_journal = journal;
+        }
+        void replay(const t_journal& journal);
+
+        // Directory ids follow the order directories are added in, so
+        // when they are added in $PATH order the first directory of a leaf
+        // is the one a PATH lookup of its name resolves to.
+        uint16_t add_directory(const std::string& path);
+        int find_directory(const std::string& path) const;
+        void remove_directory(uint16_t dir);
+        inline const std::string& directory(uint16_t dir) const
+        {
+            return this->m_dirs[dir];
+        }
+        inline size_t directory_count() const { return this->m_dirs.size(); }
+
+        bool insert(const std::string& name, uint16_t dir);
+        bool remove(const std::string& name, uint16_t dir);
+        const Leaf* find(const std::string& name) const;
+        void prefix(const std::string& prefix,
+                    std::vector<uint32_t>& leaves) const;
+
+        inline const Leaf& leaf(uint32_t id) const
+        {
+            return this->m_leaves[id];
+        }
+        inline size_t size() const { return this->m_count; }
+
+        // One character bag per leaf slot (zero for free slots), laid out
+        // contiguously so the fuzzy matcher can scan them in bulk.
+        inline const uint64_t* bags() const
+        {
+            return this->m_bags.empty() ? 0 : &this->m_bags[0];
+        }
+        inline size_t capacity() const { return this->m_leaves.size(); }
+    protected:
+        struct Node
+        {
+            std::string             label;
+            int32_t                 leaf;
+            std::vector<Node*>      children;
+
+            Node() : leaf(-1) { }
+        };
+
+        Node*                           m_root;
+        std::vector<Leaf>               m_leaves;
+        std::vector<uint64_t>           m_bags;
+        std::vector<uint32_t>           m_free;
+        std::vector<std::string>        m_dirs;
+        std::map<std::string, uint16_t> m_dir_ids;
+        size_t                          m_count;
+        t_journal*                      m_journal;
+
+        void record(Change::Kind kind, const std::string& name,
+                    uint16_t dir);
+        uint32_t allocate_leaf(const std::string& name);
+        void release_leaf(uint32_t id);
+        void collect(const Node* node, std::vector<uint32_t>& leaves) const;
+        void destroy(Node* node);
+        static Node* clone(const Node* node);
+        static Node* child(const Node* node, char c, size_t* pos = 0);
+        static void merge(Node* node);
+};
+
+#endif /* TUDOR_DO_TRIE_H */
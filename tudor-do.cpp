@@ -20,14 +20,27 @@
 #include "monitor.h"
 #include "util.h"
 
-Do::Do() : m_Xkb(), m_Entry()
+namespace
 {
-    this->m_Monitor = new PathMonitor(this->m_path);
+    // Memory the command history may take before the least recently
+    // launched commands are forgotten.
+    const size_t HISTORY_BUDGET = 1024 * 1024;
+}
+
+Do::Do() : m_Xkb(), m_Entry(), m_History(HISTORY_BUDGET), m_timing(false),
+m_refresh_rate(0), m_refresh_due(false)
+{
+    this->m_History.open(History::default_path());
+    this->m_Monitor = new PathMonitor();
+    this->m_Completer = new Completer(*this->m_Monitor,
+                                      this->m_Environment, this->m_History);
     this->update_path();
     this->bind_signals();
     this->setup_completion();
 
+    this->m_History.start();
     this->m_Monitor->start();
+    this->m_Completer->start();
 
     this->add(this->m_Entry);
     this->show_all_children();
@@ -38,6 +51,11 @@ Do::Do() : m_Xkb(), m_Entry()
 
 Do::~Do()
 {
+    this->m_refresh_timer.disconnect();
+    // The completer queries the monitor, so it goes first. Stopping the
+    // monitor also saves the cache one last time.
+    delete this->m_Completer;
+    delete this->m_Monitor;
 }
 
 void Do::bind_key(const std::string& keystring)
@@ -45,6 +63,31 @@ void Do::bind_key(const std::string& keystring)
     this->m_Xkb.bind_key(keystring);
 }
 
+void Do::set_match_mode(MatchMode mode)
+{
+    this->m_Completer->set_mode(mode);
+}
+
+void Do::set_limit(size_t limit)
+{
+    this->m_Completer->set_limit(limit);
+}
+
+void Do::set_timing(bool timing)
+{
+    this->m_timing = timing;
+}
+
+void Do::set_refresh_rate(int rate)
+{
+    this->m_refresh_rate = rate;
+}
+
+void Do::set_zygote(Zygote* zygote)
+{
+    this->m_Launcher.set_zygote(zygote);
+}
+
 void Do::bind_signals()
 {
     this->signal_delete_event().connect(sigc::mem_fun(*this,
@@ -59,17 +102,38 @@ void Do::bind_signals()
         &Do::on_entry_changed_event));
     this->m_Entry.signal_key_press_event().connect(sigc::mem_fun(*this,
         &Do::on_entry_key_pressed_event), false);
+    this->m_Completer->sig_done.connect(sigc::mem_fun(*this,
+        &Do::on_completion_ready));
+    this->m_Monitor->sig_changed.connect(sigc::mem_fun(*this,
+        &Do::on_index_changed));
 }
 
 void Do::execute(const std::string& command)
 {
-    try
+    std::vector<std::string> argv;
+    std::string file, error;
+    if (Launcher::tokenize(this->m_Environment.expand(command), argv, error))
+    {
+        // Run names the monitor already knows straight from the winning
+        // PATH directory instead of searching PATH again.
+        if (argv[0].find('/') != std::string::npos
+            || !this->m_Monitor->resolve(argv[0], file))
+            file = argv[0];
+        if (this->m_Launcher.launch(file, argv, error))
+        {
+            this->m_History.add(command);
+            if (this->m_timing)
+            {
+                const Launcher::Timing& timing = this->m_Launcher.timing();
+                fprintf(stderr, "launched %s in %.2f ms (mean %.2f ms, "
+                        "worst %.2f ms)\n", file.c_str(), timing.last / 1e3,
+                        timing.total / 1e3 / timing.count, timing.worst / 1e3);
+            }
+        }
+    }
+    if (!error.empty())
     {
-        Glib::spawn_command_line_async(command);
-        if (command.find(" ") != std::string::npos)
-            this->m_history.insert(command);
-    } catch(Glib::Error& err) {
-        Gtk::MessageDialog dialog(*this, err.what(), false, Gtk::MESSAGE_ERROR,
+        Gtk::MessageDialog dialog(*this, error, false, Gtk::MESSAGE_ERROR,
                                   Gtk::BUTTONS_OK);
         dialog.run();
     }
@@ -77,23 +141,15 @@ void Do::execute(const std::string& command)
     this->hide();
 }
 
-void Do::liststore_append(const Glib::ustring& dirname,
-                          const Glib::ustring& filename)
-{
-    Gtk::TreeModel::Row row = *(this->m_Liststore->append());
-    row[this->columns.m_col_dir] = dirname;
-    row[this->columns.m_col_file] = filename;
-}
-
 void Do::setup_completion()
 {
     Glib::RefPtr<Gtk::EntryCompletion> completion;
     completion = Gtk::EntryCompletion::create();
 
     this->m_Entry.set_completion(completion);
-    this->m_Liststore = Gtk::ListStore::create(this->columns);
+    this->m_Results = ResultModel::create();
 
-    completion->set_model(this->m_Liststore);
+    completion->set_model(this->m_Results);
     completion->set_inline_completion(true);
     completion->set_popup_single_match(true);
     completion->set_popup_completion(true);
@@ -111,6 +167,7 @@ void Do::start_xevent_loop()
 
 void Do::on_entry_activate()
 {
+    this->m_Launcher.mark();
     std::string text = this->m_Entry.get_text();
     if (text.substr(0, 1) == "/" || text.substr(0, 7) == "http://")
     {
@@ -124,22 +181,11 @@ void Do::on_entry_activate()
         this->execute(text);
 }
 
-bool Do::on_completion_match(const Glib::ustring& key,
+bool Do::on_completion_match(const Glib::ustring&,
                              const Gtk::TreeModel::const_iterator& iter)
 {
-    if (!iter) return false;
-    this->m_selected_row = *iter;
-    Glib::ustring filename = this->m_selected_row[this->columns.m_col_file];
-    filename = filename.lowercase();
-
-    int space_pos;
-    Glib::ustring match_string = key;
-    if ((space_pos = find_last_space_pos(key)) != std::string::npos)
-        match_string = key.substr(++space_pos, -1);
-    if ((!match_string.empty())
-        && (match_string.length() > 2)
-        && (filename.substr(0, match_string.size()) == match_string))
-        return true;
+    // The model only ever holds rows the completer already matched.
+    return iter;
 }
 
 bool Do::on_completion_match_selected(const Gtk::TreeModel::iterator& iter)
@@ -173,69 +219,83 @@ bool Do::on_focus_out_event(GdkEventFocus*)
 
 void Do::on_entry_changed_event()
 {
-    this->m_Liststore->clear();
-
     std::string text = this->m_Entry.get_text();
-    if (text.length() < 2) return;
+    if (Completer::current_word(text).substr(0, 1) == "/")
+        this->m_Entry.set_position(-1);
+    this->m_Completer->submit(text);
+}
 
-    int space_pos = find_last_space_pos(text);
-    if (std::string::npos != space_pos)
-        text = text.substr(++space_pos, -1);
-    if (text.empty() || text.length() <= 2)
+void Do::on_completion_ready()
+{
+    std::vector<Completion> results;
+    if (!this->m_Completer->take_results(results))
         return;
 
-    if (text.substr(0, 1) == "/")
-    {
-        this->m_Entry.set_position(-1);
-        std::string dir_name, base_name;
-        bool walk;
+    this->m_Results->set_results(results);
+    // The entry has already been filtered against the old rows; refilter
+    // now that the worker's rows are in.
+    this->m_Entry.get_completion()->complete();
+}
 
-        dir_name  = Glib::path_get_dirname(text);
-        base_name = Glib::path_get_basename(text);
+void Do::on_index_changed(const PathMonitor::t_deltas& deltas)
+{
+    if (this->m_refresh_rate <= 0 || !this->affects_results(deltas))
+        return;
+    // Within a period of the last refresh, the next one is only noted and
+    // left to the timer, however many deltas arrive meanwhile.
+    if (this->m_refresh_timer.connected())
+    {
+        this->m_refresh_due = true;
+        return;
+    }
+    this->refresh_results();
+    this->m_refresh_timer = Glib::signal_timeout().connect(sigc::mem_fun(
+        *this, &Do::on_refresh_timeout), 1000 / this->m_refresh_rate);
+}
 
-        find_and_replace(dir_name, "\\ ", " ");
-        if (!Glib::file_test(dir_name, Glib::FILE_TEST_EXISTS)) return;
+bool Do::on_refresh_timeout()
+{
+    if (!this->m_refresh_due)
+        return false;
+    this->m_refresh_due = false;
+    this->refresh_results();
+    return true;
+}
 
-        Glib::Dir dir(dir_name);
-        for (Glib::DirIterator it = dir.begin(); it != dir.end(); it++)
-        {
-            std::string name = *it;
-            if ((text.substr(text.length() - 1, -1) == "/")
-                || (name.substr(0, base_name.length()) == base_name))
-            {
-                std::string full_path = Glib::build_filename(dir_name, name);
-                find_and_replace(full_path, " ", "\\ ");
-                this->liststore_append(dir_name, full_path);
-            }
-        }
-    }
-    else if (text.substr(0, 1) == "$")
+bool Do::affects_results(const PathMonitor::t_deltas& deltas)
+{
+    if (!this->is_visible())
+        return false;
+    std::string word = Completer::current_word(this->m_Entry.get_text());
+    if (word.empty() || word[0] == '/' || word[0] == '$')
+        return false;
+
+    // A removed name matters if it is shown; an added one if it may match
+    // the word. Fuzzy matches are left to the completer to judge.
+    const std::vector<Completion>& rows = this->m_Results->get_results();
+    for (size_t i = 0; i < deltas.size(); i++)
     {
-        std::vector<std::string> env = Glib::listenv();
-        std::string key = text.substr(1);
-        for (std::vector<std::string>::iterator it = env.begin();
-             it != env.end();
-             it++)
-        {
-            if ((*it).substr(0, key.length()) == key)
-                this->liststore_append("", "$" + (*it));
-        }
+        const PathMonitor::Delta& delta = deltas[i];
+        if (delta.kind == PathMonitor::Delta::RESET)
+            return true;
+        if (delta.kind == PathMonitor::Delta::ADDED
+            && (this->m_Completer->get_mode() == MATCH_FUZZY
+                || delta.name.compare(0, word.length(), word) == 0))
+            return true;
+        for (size_t row = 0; row < rows.size(); row++)
+            if (!rows[row].dir.empty() && rows[row].name == delta.name)
+                return true;
     }
+    return false;
+}
 
-    for (Do::t_history::const_iterator iter = this->m_history.begin();
-         iter != this->m_history.end();
-         ++iter)
-        if ((text.length() <= (*iter).length())
-            && ((*iter).compare(0, text.length(), text) == 0))
-            this->liststore_append("", (*iter));
-
-    for (Do::t_path_map::const_iterator iter = this->m_path.begin();
-         iter != this->m_path.end();
-         ++iter)
-        for (int it = 0; it < (iter->second).size(); it++)
-            if ((text.length() <= iter->second[it].length())
-                && (iter->second[it].compare(0, text.length(), text) == 0))
-                this->liststore_append(iter->first, iter->second[it]);
+void Do::refresh_results()
+{
+    // The completer notices the new index generation and queries it
+    // afresh; on_completion_ready() then applies only the rows that
+    // changed.
+    if (this->is_visible())
+        this->m_Completer->submit(this->m_Entry.get_text());
 }
 
 bool Do::on_entry_key_pressed_event(GdkEventKey* event)
@@ -267,7 +327,7 @@ bool Do::on_entry_key_pressed_event(GdkEventKey* event)
         else if (text.empty() || text.length() <= 2) return true;
 
         Gtk::TreeModel::Row row;
-        row  = *(this->m_Liststore->children().begin());
+        row  = *(this->m_Results->children().begin());
         if (!row)
         {
             this->m_Entry.set_position(-1);
@@ -311,11 +371,17 @@ void Do::update_path()
     std::string path = Glib::getenv("PATH");
     if ((dirs = split(path, ':')).empty())
         fatal_error("missing PATH");
+    // Directories must be registered in PATH order; see
+    // PathTrie::add_directory.
+    std::vector<std::string> stale;
     for (int i=0; i < dirs.size(); i++)
     {
-        this->m_Monitor->update_directory_listing(dirs[i]);
+        if (!this->m_Monitor->restore_directory_listing(dirs[i]))
+            stale.push_back(dirs[i]);
         this->m_Monitor->monitor_directory(dirs[i]);
     }
+    if (!stale.empty())
+        this->m_Monitor->update_directory_listings(stale);
 }
 
 int main(int argc, char* argv[])
@@ -329,6 +395,18 @@ int main(int argc, char* argv[])
     entry.set_description("Set hotkey string");
     options.add_entry(entry, hotkey);
 
+    Glib::ustring match = "prefix";
+    entry.set_long_name("match");
+    entry.set_short_name('m');
+    entry.set_description("Set the completion mode (prefix or fuzzy)");
+    options.add_entry(entry, match);
+
+    int limit = 50;
+    entry.set_long_name("limit");
+    entry.set_short_name('l');
+    entry.set_description("Set the maximum number of completions shown");
+    options.add_entry(entry, limit);
+
     bool undecorated(false);
     entry.set_long_name("undecorated");
     entry.set_short_name('u');
@@ -341,6 +419,19 @@ int main(int argc, char* argv[])
     entry.set_description("Set the title of the window");
     options.add_entry(entry, title);
 
+    bool timing(false);
+    entry.set_long_name("timing");
+    entry.set_short_name('T');
+    entry.set_description("Print how long each launch took");
+    options.add_entry(entry, timing);
+
+    int refresh_rate = 2;
+    entry.set_long_name("refresh-rate");
+    entry.set_short_name('r');
+    entry.set_description("Update shown completions as $PATH changes at most "
+                          "this many times a second (0 disables)");
+    options.add_entry(entry, refresh_rate);
+
     bool version(false);
     entry.set_long_name("version");
     entry.set_description("Print version information and exit");
@@ -349,6 +440,12 @@ int main(int argc, char* argv[])
     Glib::OptionContext context("");
     context.add_group(options);
 
+    // Fork the launch helper while this process is still small and has
+    // neither threads nor an X connection.
+    Zygote zygote;
+    if (!zygote.start())
+        warning("cannot start launch helper, launching directly");
+
     if(!Glib::thread_supported()) Glib::thread_init();
     Gtk::Main kit(argc, argv, context);
     if (version)
@@ -356,9 +453,20 @@ int main(int argc, char* argv[])
         std::cout << "tudor-do 0.1.2" << std::endl;
         return 0;
     }
+    if (match != "prefix" && match != "fuzzy")
+        fatal_error("unknown completion mode: " + match);
+    if (limit <= 0 || limit > 1000)
+        fatal_error("completion limit must be between 1 and 1000");
+    if (refresh_rate < 0 || refresh_rate > 1000)
+        fatal_error("refresh rate must be between 0 and 1000");
 
     Do main_window;
     main_window.bind_key(hotkey);
+    main_window.set_match_mode(match == "fuzzy" ? MATCH_FUZZY : MATCH_PREFIX);
+    main_window.set_limit(limit);
+    main_window.set_timing(timing);
+    main_window.set_refresh_rate(refresh_rate);
+    main_window.set_zygote(&zygote);
     main_window.set_decorated(!undecorated);
     main_window.set_title(title);
 
@@ -16,6 +16,11 @@
 #include <set>
 #include <glibmm.h>
 #include <gtkmm.h>
+#include "completer.h"
+#include "environment.h"
+#include "history.h"
+#include "launcher.h"
+#include "result-model.h"
 #include "xkeybind.h"
 
 class PathMonitor;
@@ -23,22 +28,30 @@ class PathMonitor;
 class Do : public Gtk::Window
 {
     public:
-        typedef std::map<std::string, std::vector<std::string> > t_path_map;
-        typedef std::set<std::string> t_history;
-
         Do();
         virtual ~Do();
         void bind_key(const std::string& keystring);
+        void set_match_mode(MatchMode mode);
+        void set_limit(size_t limit);
+        void set_timing(bool timing);
+        // Caps how often a second the open results follow $PATH changes;
+        // 0 leaves them alone until the next keystroke.
+        void set_refresh_rate(int rate);
+        void set_zygote(Zygote* zygote);
         void start_xevent_loop();
     protected:
-        Glib::RefPtr<Gtk::ListStore>    m_Liststore;
+        Glib::RefPtr<ResultModel>       m_Results;
         Gtk::Entry                      m_Entry;
+        Environment                     m_Environment;
+        History                         m_History;
         PathMonitor*                    m_Monitor;
+        Completer*                      m_Completer;
         XKeyBind                        m_Xkb;
-
-        Gtk::TreeRow                    m_selected_row;
-        std::set<std::string>           m_history;
-        t_path_map                      m_path;
+        Launcher                        m_Launcher;
+        bool                            m_timing;
+        int                             m_refresh_rate;
+        bool                            m_refresh_due;
+        sigc::connection                m_refresh_timer;
 
         class PathModelColumns : public Gtk::TreeModel::ColumnRecord
         {
@@ -55,13 +68,14 @@ class Do : public Gtk::Window
 
         void bind_signals();
         void execute(const std::string& command);
-        void liststore_append(const Glib::ustring& dirname,
-                              const Glib::ustring& filename);
         void setup_completion();
 
         bool on_completion_match(const Glib::ustring& key,
                                  const Gtk::TreeModel::const_iterator& iter);
         bool on_completion_match_selected(const Gtk::TreeModel::iterator& iter);
+        void on_completion_ready();
+        void on_index_changed(const PathMonitor::t_deltas& deltas);
+        bool on_refresh_timeout();
         bool on_delete_event(GdkEventAny* event);
         bool on_focus_out_event(GdkEventFocus* event);
         void on_entry_activate();
@@ -69,6 +83,8 @@ class Do : public Gtk::Window
         bool on_entry_key_pressed_event(GdkEventKey* event);
         bool on_key_pressed_event(GdkEventKey* event);
 
+        bool affects_results(const PathMonitor::t_deltas& deltas);
+        void refresh_results();
         void update_path();
 };
 
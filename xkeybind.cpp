@@ -7,6 +7,7 @@
     :copyright: (c) 2010 David 'dav' Gidwani
     :license: New BSD License. See LICENSE for details.
 */
+#include <fcntl.h>
 #include "util.h"
 #include "xkeybind.h"
 
@@ -63,13 +64,18 @@ Display* XKeyBind::get_active_display()
 {
     Display* m_dpy = XOpenDisplay(NULL);
     if (!m_dpy) fatal_error("unable to open display");
+    // Launched commands must not inherit the connection.
+    fcntl(ConnectionNumber(m_dpy), F_SETFD, FD_CLOEXEC);
     return m_dpy;
 }
 
 unsigned int XKeyBind::get_keycode(const std::string& character)
 {
-    return XKeysymToKeycode(XKeyBind::get_active_display(),
+    Display* dpy = XKeyBind::get_active_display();
+    unsigned int keycode = XKeysymToKeycode(dpy,
         XStringToKeysym(character.c_str()));
+    XCloseDisplay(dpy);
+    return keycode;
 }
 
 unsigned int XKeyBind::get_modifiermask(const std::string& modifier_str)
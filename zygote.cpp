@@ -0,0 +1,227 @@
+/*
+    zygote
+    ~~~~~~
+
+    A small helper process, forked before GTK and X are initialized, that
+    starts commands on behalf of the main process. Children forked from it
+    inherit neither the GTK process's address space nor its descriptors and
+    signal handlers.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "zygote.h"
+
+namespace
+{
+    // Sent ahead of every request. The payload holds the file, the
+    // working directory, then |argc| arguments and |envc| environment
+    // strings, all NUL-terminated.
+    struct Request
+    {
+        uint32_t    bytes;
+        uint32_t    argc;
+        uint32_t    envc;
+    };
+
+    // Anything larger is not a request this process would send.
+    const uint32_t MAX_REQUEST = 4 * 1024 * 1024;
+
+    bool read_all(int fd, void* data, size_t length)
+    {
+        char* p = (char*) data;
+        while (length > 0)
+        {
+            ssize_t n = read(fd, p, length);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            length -= n;
+        }
+        return true;
+    }
+
+    bool write_all(int fd, const void* data, size_t length)
+    {
+        const char* p = (const char*) data;
+        while (length > 0)
+        {
+            ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            length -= n;
+        }
+        return true;
+    }
+}
+
+Zygote::Zygote() : m_fd(-1), m_pid(-1)
+{
+}
+
+Zygote::~Zygote()
+{
+    this->stop();
+}
+
+bool Zygote::start()
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+        return false;
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        Zygote::serve(fds[1]);
+    }
+    close(fds[1]);
+    this->m_fd = fds[0];
+    this->m_pid = pid;
+    return true;
+}
+
+void Zygote::stop()
+{
+    // The helper exits as soon as it reads end-of-file.
+    if (this->m_fd != -1)
+        close(this->m_fd);
+    if (this->m_pid != -1)
+        waitpid(this->m_pid, 0, 0);
+    this->m_fd = -1;
+    this->m_pid = -1;
+}
+
+bool Zygote::launch(const std::string& file,
+                    const std::vector<std::string>& argv,
+                    const std::vector<std::string>& env,
+                    const std::string& cwd, int& err)
+{
+    if (this->m_fd == -1)
+        return false;
+
+    std::string payload;
+    payload.append(file.c_str(), file.length() + 1);
+    payload.append(cwd.c_str(), cwd.length() + 1);
+    for (size_t i = 0; i < argv.size(); i++)
+        payload.append(argv[i].c_str(), argv[i].length() + 1);
+    for (size_t i = 0; i < env.size(); i++)
+        payload.append(env[i].c_str(), env[i].length() + 1);
+
+    Request request = { (uint32_t) payload.size(), (uint32_t) argv.size(),
+                        (uint32_t) env.size() };
+    int32_t status;
+    if (payload.size() > MAX_REQUEST
+        || !write_all(this->m_fd, &request, sizeof(request))
+        || !write_all(this->m_fd, payload.data(), payload.size())
+        || !read_all(this->m_fd, &status, sizeof(status)))
+    {
+        // A helper that cannot be talked to is of no further use.
+        this->stop();
+        return false;
+    }
+    err = status;
+    return true;
+}
+
+void Zygote::serve(int fd)
+{
+    // Nobody waits for the commands started from here.
+    signal(SIGCHLD, SIG_IGN);
+
+    std::vector<char> payload;
+    std::vector<char*> strings;
+    Request request;
+    while (read_all(fd, &request, sizeof(request)))
+    {
+        if (request.bytes == 0 || request.bytes > MAX_REQUEST)
+            break;
+        payload.resize(request.bytes);
+        if (!read_all(fd, &payload[0], payload.size()))
+            break;
+        payload.back() = '\0';
+
+        strings.clear();
+        for (size_t pos = 0; pos < payload.size();
+             pos += strlen(&payload[pos]) + 1)
+            strings.push_back(&payload[pos]);
+
+        int32_t status = EINVAL;
+        if (request.argc > 0
+            && strings.size() == 2 + request.argc + request.envc)
+        {
+            // Split the strings into NULL-terminated argv and envp arrays.
+            std::vector<char*> argv(strings.begin() + 2,
+                                    strings.begin() + 2 + request.argc);
+            std::vector<char*> env(strings.begin() + 2 + request.argc,
+                                   strings.end());
+            argv.push_back(0);
+            env.push_back(0);
+            status = Zygote::spawn(strings[0], &argv[0], &env[0], strings[1]);
+        }
+        if (!write_all(fd, &status, sizeof(status)))
+            break;
+    }
+    _exit(0);
+}
+
+int Zygote::spawn(const char* file, char* const* argv, char* const* env,
+                  const char* cwd)
+{
+    // The child reports a failed exec through this pipe; a successful
+    // exec closes it without writing anything.
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+        return errno;
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        int err = errno;
+        close(fds[0]);
+        close(fds[1]);
+        return err;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        signal(SIGCHLD, SIG_DFL);
+        int err;
+        if (cwd[0] && chdir(cwd) == -1)
+            err = errno;
+        else
+        {
+            if (strchr(file, '/'))
+                execve(file, argv, env);
+            else
+                execvpe(file, argv, env);
+            err = errno;
+        }
+        // The parent reads no report as a successful exec, so there is
+        // nothing more to do if even this fails.
+        while (write(fds[1], &err, sizeof(err)) == -1 && errno == EINTR)
+            ;
+        _exit(127);
+    }
+    close(fds[1]);
+    int err = 0;
+    ssize_t n;
+    while ((n = read(fds[0], &err, sizeof(err))) == -1 && errno == EINTR)
+        ;
+    close(fds[0]);
+    return (n == sizeof(err)) ? err : 0;
+}
@@ -0,0 +1,48 @@
+/*
+    zygote
+    ~~~~~~
+
+    A small helper process, forked before GTK and X are initialized, that
+    starts commands on behalf of the main process. Children forked from it
+    inherit neither the GTK process's address space nor its descriptors and
+    signal handlers.
+
+    :copyright: (c) 2010 David 'dav' Gidwani
+    :license: New BSD License. See LICENSE for details.
+*/
+#ifndef TUDOR_DO_ZYGOTE_H
+#define TUDOR_DO_ZYGOTE_H
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+class Zygote
+{
+    public:
+        Zygote();
+        virtual ~Zygote();
+
+        // Forks the helper. Call this before any thread is started or any
+        // descriptor the children should not see is opened.
+        bool start();
+        void stop();
+        inline bool running() const { return this->m_fd != -1; }
+
+        // Asks the helper to run |file| (looked up in $PATH unless it
+        // contains a slash) with |argv| and |env| in |cwd|. Returns false
+        // when the helper cannot be reached; otherwise |err| is the errno
+        // exec failed with, or zero once the command is running.
+        bool launch(const std::string& file,
+                    const std::vector<std::string>& argv,
+                    const std::vector<std::string>& env,
+                    const std::string& cwd, int& err);
+    protected:
+        int     m_fd;
+        pid_t   m_pid;
+
+        static void serve(int fd);
+        static int spawn(const char* file, char* const* argv,
+                         char* const* env, const char* cwd);
+};
+
+#endif /* TUDOR_DO_ZYGOTE_H */